@@ -0,0 +1,138 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#ifndef BENCH_H
+#define BENCH_H
+
+// Helpers shared by the benchmark programs: timing, cpu pinning, option lists, percentiles and CSV/JSON rows.
+
+#define BENCH_MAX_LIST 16
+
+struct bench_list {
+    int vals[BENCH_MAX_LIST];
+    int n;
+};
+
+struct bench_out {
+    bool json;
+    int rows;
+};
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline void bench_pin_thread(int idx, bool pin)
+{
+    // spread threads round robin over the cpus this process may run on
+    if (!pin)
+        return;
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+        return;
+
+    int ncpus = CPU_COUNT(&allowed);
+    int target = idx % ncpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        if (target-- == 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            return;
+        }
+    }
+}
+
+static inline void bench_parse_list(struct bench_list *list, const char *arg)
+{
+    // comma separated list of positive integers, e.g. "1,2,4"
+    list->n = 0;
+    char *buf = strdup(arg);
+    for (char *tok = strtok(buf, ","); tok && list->n < BENCH_MAX_LIST; tok = strtok(NULL, ","))
+        list->vals[list->n++] = atoi(tok);
+    free(buf);
+}
+
+static int bench_u64_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static inline void bench_sort(uint64_t *samples, size_t n)
+{
+    qsort(samples, n, sizeof(uint64_t), bench_u64_cmp);
+}
+
+static inline uint64_t bench_percentile(const uint64_t *sorted, size_t n, double p)
+{
+    if (n == 0)
+        return 0;
+    size_t idx = (size_t)(p * (double)(n - 1));
+    return sorted[idx];
+}
+
+static inline void bench_output_begin(struct bench_out *out, bool json, int nfields, const char **names)
+{
+    out->json = json;
+    out->rows = 0;
+    if (json)
+    {
+        printf("[\n");
+        return;
+    }
+
+    for (int i = 0; i < nfields; i++)
+        printf("%s%s", i ? "," : "", names[i]);
+    printf("\n");
+}
+
+static inline void bench_output_row(struct bench_out *out, int nfields, const char **names, const char **values)
+{
+    if (!out->json)
+    {
+        for (int i = 0; i < nfields; i++)
+            printf("%s%s", i ? "," : "", values[i]);
+        printf("\n");
+        fflush(stdout);
+        return;
+    }
+
+    printf("%s  {", out->rows ? ",\n" : "");
+    for (int i = 0; i < nfields; i++)
+    {
+        // numbers are emitted bare, anything else is quoted
+        char *end;
+        strtod(values[i], &end);
+        bool numeric = *values[i] && *end == '\0';
+        printf("%s\"%s\": %s%s%s", i ? ", " : "", names[i], numeric ? "" : "\"", values[i], numeric ? "" : "\"");
+    }
+    printf("}");
+    fflush(stdout);
+    out->rows++;
+}
+
+static inline void bench_output_end(struct bench_out *out)
+{
+    if (out->json)
+        printf("\n]\n");
+}
+
+#endif
@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bench.h"
+#include "queue.h"
+#include "multi_queue.h"
+#include "reclaimer.h"
+
+#ifdef ATM_RECLAIM_HP
+#define BENCH_BACKEND "hp"
+#else
+#define BENCH_BACKEND "ebr"
+#endif
+
+// handed to each consumer once every producer has finished, tells it to stop
+static char stop_pill;
+
+struct queue_bench_config {
+    int producers;
+    int consumers;
+    // 0 runs against a single atm_queue, anything else against an atm_multi_queue with that many shards
+    int shards;
+    int batch;
+    long ops;
+    int sample_every;
+    bool pin;
+};
+
+struct queue_bench_thread {
+    void *q;
+    pthread_barrier_t *start;
+    struct queue_bench_config *cfg;
+    int idx;
+    uint64_t *samples;
+    size_t nsamples;
+};
+
+static void queue_bench_enqueue(struct queue_bench_config *cfg, void *q, void *item)
+{
+    if (cfg->shards)
+        atm_multi_queue_enqueue(q, item);
+    else
+        atm_queue_enqueue(q, item);
+}
+
+static size_t queue_bench_dequeue(struct queue_bench_config *cfg, void *q, void **out)
+{
+    if (cfg->shards)
+        return (out[0] = atm_multi_queue_dequeue(q)) != NULL;
+    if (cfg->batch > 1)
+        return atm_queue_dequeue_bulk(q, out, cfg->batch);
+    return (out[0] = atm_queue_dequeue(q)) != NULL;
+}
+
+void *queue_bench_producer(void *args)
+{
+    struct queue_bench_thread *t = (struct queue_bench_thread *)args;
+    struct queue_bench_config *cfg = t->cfg;
+    bench_pin_thread(t->idx, cfg->pin);
+    pthread_barrier_wait(t->start);
+
+    void *items[512];
+    long calls = 0;
+    for (long i = 0; i < cfg->ops; )
+    {
+        // items are never dereferenced, any non NULL pointer other than the stop pill will do
+        int n = cfg->batch > 1 ? cfg->batch : 1;
+        if (n > cfg->ops - i)
+            n = cfg->ops - i;
+        for (int j = 0; j < n; j++)
+            items[j] = (void*)(uintptr_t)(i + j + 16);
+
+        bool sample = (calls++ % cfg->sample_every) == 0;
+        uint64_t start = sample ? bench_now_ns() : 0;
+        if (cfg->batch > 1)
+            atm_queue_enqueue_bulk(t->q, items, n);
+        else
+            queue_bench_enqueue(cfg, t->q, items[0]);
+        if (sample)
+            t->samples[t->nsamples++] = bench_now_ns() - start;
+
+        i += n;
+    }
+
+    return NULL;
+}
+
+void *queue_bench_consumer(void *args)
+{
+    struct queue_bench_thread *t = (struct queue_bench_thread *)args;
+    struct queue_bench_config *cfg = t->cfg;
+    bench_pin_thread(t->idx, cfg->pin);
+    pthread_barrier_wait(t->start);
+
+    void *out[512];
+    long calls = 0;
+    bool stopping = false;
+    while (1)
+    {
+        bool sample = (calls % cfg->sample_every) == 0;
+        uint64_t start = sample ? bench_now_ns() : 0;
+        size_t n = queue_bench_dequeue(cfg, t->q, out);
+        uint64_t end = sample ? bench_now_ns() : 0;
+
+        if (n == 0)
+        {
+            // producers are done once we hold a pill, so an empty queue means every item has been taken
+            if (stopping)
+                return NULL;
+
+            // only successful dequeues count towards latency, give producers the cpu when oversubscribed
+            sched_yield();
+            continue;
+        }
+
+        if (sample)
+            t->samples[t->nsamples++] = end - start;
+        calls++;
+
+        // a sharded queue can hand out a pill before items on other shards, so keep draining after our own
+        // pill and leave as soon as we meet another consumer's, putting it back. The last consumer to
+        // take its pill finds no others and drains the queue
+        int pills = 0;
+        for (size_t i = 0; i < n; i++)
+            pills += out[i] == &stop_pill;
+        if (pills && !stopping)
+        {
+            stopping = true;
+            pills--;
+        }
+        if (pills)
+        {
+            for (int i = 0; i < pills; i++)
+                queue_bench_enqueue(cfg, t->q, &stop_pill);
+            return NULL;
+        }
+    }
+}
+
+static double queue_bench_run(struct queue_bench_config *cfg, uint64_t **enq, size_t *nenq, uint64_t **deq, size_t *ndeq)
+{
+    atm_queue q;
+    atm_multi_queue mq;
+    void *target = &q;
+    if (cfg->shards)
+    {
+        atm_multi_queue_init(&mq, cfg->shards);
+        target = &mq;
+    }
+    else
+        atm_queue_init(&q);
+
+    int nthreads = cfg->producers + cfg->consumers;
+    pthread_t threads[nthreads];
+    struct queue_bench_thread args[nthreads];
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, nthreads + 1);
+
+    size_t max_samples = cfg->ops / cfg->sample_every + 2;
+    for (int i = 0; i < nthreads; i++)
+    {
+        args[i] = (struct queue_bench_thread) { .q=target, .start=&start, .cfg=cfg, .idx=i, .nsamples=0 };
+        args[i].samples = malloc(max_samples * (i < cfg->producers ? 1 : cfg->producers + 1) * sizeof(uint64_t));
+        void *(*body)(void*) = i < cfg->producers ? queue_bench_producer : queue_bench_consumer;
+        if (pthread_create(threads + i, NULL, body, args + i))
+        {
+            fprintf(stderr, "unable to spawn bench thread: (%d) %s\n", errno, strerror(errno));
+            exit(1);
+        }
+    }
+
+    pthread_barrier_wait(&start);
+    uint64_t begin = bench_now_ns();
+
+    for (int i = 0; i < cfg->producers; i++)
+        pthread_join(threads[i], NULL);
+    for (int i = 0; i < cfg->consumers; i++)
+        queue_bench_enqueue(cfg, target, &stop_pill);
+    for (int i = cfg->producers; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    double seconds = (double)(bench_now_ns() - begin) / 1e9;
+
+    // merge per thread samples into one set per side
+    *nenq = 0;
+    *ndeq = 0;
+    *enq = malloc(max_samples * cfg->producers * sizeof(uint64_t));
+    *deq = malloc(max_samples * (cfg->producers + 1) * cfg->consumers * sizeof(uint64_t));
+    for (int i = 0; i < nthreads; i++)
+    {
+        uint64_t *dst = i < cfg->producers ? *enq + *nenq : *deq + *ndeq;
+        memcpy(dst, args[i].samples, args[i].nsamples * sizeof(uint64_t));
+        if (i < cfg->producers)
+            *nenq += args[i].nsamples;
+        else
+            *ndeq += args[i].nsamples;
+        free(args[i].samples);
+    }
+
+    pthread_barrier_destroy(&start);
+    if (cfg->shards)
+        free_atm_multi_queue_auto(&mq);
+    else
+        free_atm_queue_auto(&q);
+    return seconds;
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_list producers, consumers, shards;
+    bench_parse_list(&producers, "1,2,4");
+    bench_parse_list(&consumers, "1,2,4");
+    bench_parse_list(&shards, "0");
+    long ops = 200000;
+    long warmup = 20000;
+    int repeats = 3;
+    int batch = 1;
+    int sample_every = 16;
+    bool json = false;
+    bool pin = true;
+    bool background = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "P:C:k:n:w:r:b:s:f:aBh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'P': bench_parse_list(&producers, optarg); break;
+            case 'C': bench_parse_list(&consumers, optarg); break;
+            case 'k': bench_parse_list(&shards, optarg); break;
+            case 'n': ops = atol(optarg); break;
+            case 'w': warmup = atol(optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            case 'b': batch = atoi(optarg); break;
+            case 's': sample_every = atoi(optarg); break;
+            case 'f': json = strcmp(optarg, "json") == 0; break;
+            case 'a': pin = false; break;
+            case 'B': background = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-P producers,..] [-C consumers,..] [-k shards,.. 0 for atm_queue] [-n ops per producer] [-w warmup ops] "
+                                "[-r repeats] [-b batch] [-s sample every] [-f csv|json] [-a no pinning] [-B background reclaimer]\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    // hands reclaim passes to a background thread instead of whichever consumer retires enough nodes
+    if (background)
+        atm_reclaimer_start();
+
+    if (batch > 512)
+        batch = 512;
+    if (sample_every < 1)
+        sample_every = 1;
+
+    const char *names[] = { "bench", "backend", "reclaim", "shards", "producers", "consumers", "batch", "run", "items", "seconds", "items_per_sec",
+                            "enq_p50_ns", "enq_p99_ns", "enq_p999_ns", "deq_p50_ns", "deq_p99_ns", "deq_p999_ns" };
+    int nfields = sizeof(names) / sizeof(names[0]);
+    struct bench_out out;
+    bench_output_begin(&out, json, nfields, names);
+
+    for (int k = 0; k < shards.n; k++)
+    {
+        for (int p = 0; p < producers.n; p++)
+        {
+            for (int c = 0; c < consumers.n; c++)
+            {
+                // the multi queue has no bulk operations, so shard runs always move one item at a time
+                struct queue_bench_config cfg = { .producers=producers.vals[p], .consumers=consumers.vals[c],
+                                                  .shards=shards.vals[k], .batch=shards.vals[k] ? 1 : batch,
+                                                  .ops=warmup, .sample_every=sample_every, .pin=pin };
+                uint64_t *enq, *deq;
+                size_t nenq, ndeq;
+
+                // warm caches, the allocator and the node pool before anything is timed
+                if (warmup > 0)
+                {
+                    queue_bench_run(&cfg, &enq, &nenq, &deq, &ndeq);
+                    free(enq);
+                    free(deq);
+                }
+
+                cfg.ops = ops;
+                for (int run = 0; run < repeats; run++)
+                {
+                    double seconds = queue_bench_run(&cfg, &enq, &nenq, &deq, &ndeq);
+                    bench_sort(enq, nenq);
+                    bench_sort(deq, ndeq);
+
+                    long items = ops * cfg.producers;
+                    char v[17][32];
+                    snprintf(v[0], 32, "queue");
+                    snprintf(v[1], 32, "%s", BENCH_BACKEND);
+                    snprintf(v[2], 32, "%s", background ? "background" : "inline");
+                    snprintf(v[3], 32, "%d", cfg.shards);
+                    snprintf(v[4], 32, "%d", cfg.producers);
+                    snprintf(v[5], 32, "%d", cfg.consumers);
+                    snprintf(v[6], 32, "%d", cfg.batch);
+                    snprintf(v[7], 32, "%d", run);
+                    snprintf(v[8], 32, "%ld", items);
+                    snprintf(v[9], 32, "%.6f", seconds);
+                    snprintf(v[10], 32, "%.0f", (double)items / seconds);
+                    snprintf(v[11], 32, "%llu", (unsigned long long)bench_percentile(enq, nenq, 0.50));
+                    snprintf(v[12], 32, "%llu", (unsigned long long)bench_percentile(enq, nenq, 0.99));
+                    snprintf(v[13], 32, "%llu", (unsigned long long)bench_percentile(enq, nenq, 0.999));
+                    snprintf(v[14], 32, "%llu", (unsigned long long)bench_percentile(deq, ndeq, 0.50));
+                    snprintf(v[15], 32, "%llu", (unsigned long long)bench_percentile(deq, ndeq, 0.99));
+                    snprintf(v[16], 32, "%llu", (unsigned long long)bench_percentile(deq, ndeq, 0.999));
+
+                    const char *values[17];
+                    for (int i = 0; i < nfields; i++)
+                        values[i] = v[i];
+                    bench_output_row(&out, nfields, names, values);
+
+                    free(enq);
+                    free(deq);
+                }
+            }
+        }
+    }
+
+    bench_output_end(&out);
+    atm_reclaimer_stop();
+    return 0;
+}
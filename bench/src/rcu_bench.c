@@ -0,0 +1,256 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bench.h"
+#include "rcu.h"
+#include "reclaimer.h"
+
+#ifdef ATM_RECLAIM_HP
+#define BENCH_BACKEND "hp"
+#else
+#define BENCH_BACKEND "ebr"
+#endif
+
+enum rcu_bench_mode { RCU_BENCH_COPY, RCU_BENCH_LOCK };
+enum rcu_bench_update { RCU_BENCH_SET, RCU_BENCH_FN, RCU_BENCH_COMBINE };
+static const char *rcu_bench_update_names[] = { "set", "fn", "combine" };
+
+// runs are sequential, so the copy function and writers can read the payload size and update kind from here
+static size_t payload_size;
+static enum rcu_bench_update update_kind = RCU_BENCH_SET;
+
+static void *payload_cpy(void *src)
+{
+    void *dst = malloc(payload_size);
+    memcpy(dst, src, payload_size);
+    return dst;
+}
+
+struct rcu_bench_thread {
+    rcu_t *rcu;
+    pthread_barrier_t *start;
+    _Atomic bool *stop;
+    enum rcu_bench_mode mode;
+    int idx;
+    bool pin;
+    unsigned long count;
+    unsigned long sink;
+};
+
+void *rcu_bench_reader(void *args)
+{
+    struct rcu_bench_thread *t = (struct rcu_bench_thread *)args;
+    bench_pin_thread(t->idx, t->pin);
+    pthread_barrier_wait(t->start);
+
+    while (!atomic_load_explicit(t->stop, memory_order_relaxed))
+    {
+        // touch the first and last byte so the read cannot be optimised away
+        if (t->mode == RCU_BENCH_COPY)
+        {
+            unsigned char *p = rcu_read(t->rcu);
+            t->sink += p[0] + p[payload_size - 1];
+            free(p);
+        }
+        else
+        {
+            const unsigned char *p = rcu_read_lock(t->rcu);
+            t->sink += p[0] + p[payload_size - 1];
+            rcu_read_unlock(t->rcu);
+        }
+        t->count++;
+    }
+
+    return NULL;
+}
+
+static void payload_touch(void *data, void *ctx)
+{
+    ((unsigned char *)data)[0] = (unsigned char)*(unsigned long *)ctx;
+}
+
+void *rcu_bench_writer(void *args)
+{
+    struct rcu_bench_thread *t = (struct rcu_bench_thread *)args;
+    bench_pin_thread(t->idx, t->pin);
+    pthread_barrier_wait(t->start);
+
+    while (!atomic_load_explicit(t->stop, memory_order_relaxed))
+    {
+        // set publishes a fresh payload, fn and combine mutate a copy of the current one
+        if (update_kind == RCU_BENCH_SET)
+        {
+            unsigned char *p = malloc(payload_size);
+            memset(p, (int)(t->count & 0xff), payload_size);
+            rcu_update(t->rcu, p);
+        }
+        else if (update_kind == RCU_BENCH_FN)
+            rcu_update_fn(t->rcu, payload_touch, &(t->count));
+        else
+            rcu_update_combined(t->rcu, payload_touch, &(t->count));
+        t->count++;
+    }
+
+    return NULL;
+}
+
+static double rcu_bench_run(enum rcu_bench_mode mode, int readers, int writers, long duration_ms, bool pin,
+                            unsigned long *reads, unsigned long *updates)
+{
+    // free_rcu releases the handle too, so it has to live on the heap
+    rcu_t *rcu = malloc(sizeof(rcu_t));
+    void *initial = malloc(payload_size);
+    memset(initial, 0, payload_size);
+    rcu_init_with(rcu, payload_cpy, initial);
+
+    int nthreads = readers + writers;
+    pthread_t threads[nthreads];
+    struct rcu_bench_thread args[nthreads];
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, nthreads + 1);
+    _Atomic bool stop = false;
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        args[i] = (struct rcu_bench_thread) { .rcu=rcu, .start=&start, .stop=&stop, .mode=mode, .idx=i, .pin=pin };
+        if (pthread_create(threads + i, NULL, i < readers ? rcu_bench_reader : rcu_bench_writer, args + i))
+        {
+            fprintf(stderr, "unable to spawn bench thread: (%d) %s\n", errno, strerror(errno));
+            exit(1);
+        }
+    }
+
+    pthread_barrier_wait(&start);
+    uint64_t begin = bench_now_ns();
+    struct timespec ts = { .tv_sec=duration_ms / 1000, .tv_nsec=(duration_ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+    atomic_store_explicit(&stop, true, memory_order_relaxed);
+
+    *reads = 0;
+    *updates = 0;
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+        if (i < readers)
+            *reads += args[i].count;
+        else
+            *updates += args[i].count;
+    }
+
+    double seconds = (double)(bench_now_ns() - begin) / 1e9;
+    pthread_barrier_destroy(&start);
+    free_rcu(rcu);
+    return seconds;
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_list readers, writers, sizes;
+    bench_parse_list(&readers, "1,2,4");
+    bench_parse_list(&writers, "0,1,2");
+    bench_parse_list(&sizes, "64,1024,16384");
+    long duration_ms = 200;
+    long warmup_ms = 50;
+    int repeats = 3;
+    bool modes[2] = { true, true };
+    bool json = false;
+    bool pin = true;
+    bool background = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "R:W:S:d:w:r:m:u:f:aBh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'R': bench_parse_list(&readers, optarg); break;
+            case 'W': bench_parse_list(&writers, optarg); break;
+            case 'S': bench_parse_list(&sizes, optarg); break;
+            case 'd': duration_ms = atol(optarg); break;
+            case 'w': warmup_ms = atol(optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            case 'm':
+                modes[RCU_BENCH_COPY] = strcmp(optarg, "lock") != 0;
+                modes[RCU_BENCH_LOCK] = strcmp(optarg, "copy") != 0;
+                break;
+            case 'u':
+                for (int u = RCU_BENCH_SET; u <= RCU_BENCH_COMBINE; u++)
+                    if (strcmp(optarg, rcu_bench_update_names[u]) == 0)
+                        update_kind = u;
+                break;
+            case 'f': json = strcmp(optarg, "json") == 0; break;
+            case 'a': pin = false; break;
+            case 'B': background = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-R readers,..] [-W writers,..] [-S payload bytes,..] [-d duration ms] "
+                                "[-w warmup ms] [-r repeats] [-m copy|lock|both] [-u set|fn|combine] [-f csv|json] [-a no pinning] [-B background reclaimer]\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    // hands reclaim passes, and the frees of old versions, to a background thread instead of the writers
+    if (background)
+        atm_reclaimer_start();
+
+    const char *names[] = { "bench", "backend", "reclaim", "mode", "update", "readers", "writers", "payload", "run", "seconds",
+                            "reads", "updates", "reads_per_sec", "updates_per_sec" };
+    int nfields = sizeof(names) / sizeof(names[0]);
+    struct bench_out out;
+    bench_output_begin(&out, json, nfields, names);
+
+    for (int m = RCU_BENCH_COPY; m <= RCU_BENCH_LOCK; m++)
+    {
+        if (!modes[m])
+            continue;
+        for (int s = 0; s < sizes.n; s++)
+        {
+            payload_size = sizes.vals[s] > 0 ? sizes.vals[s] : 1;
+            for (int r = 0; r < readers.n; r++)
+            {
+                for (int w = 0; w < writers.n; w++)
+                {
+                    if (readers.vals[r] + writers.vals[w] == 0)
+                        continue;
+
+                    unsigned long reads, updates;
+                    if (warmup_ms > 0)
+                        rcu_bench_run(m, readers.vals[r], writers.vals[w], warmup_ms, pin, &reads, &updates);
+
+                    for (int run = 0; run < repeats; run++)
+                    {
+                        double seconds = rcu_bench_run(m, readers.vals[r], writers.vals[w], duration_ms, pin, &reads, &updates);
+
+                        char v[14][32];
+                        snprintf(v[0], 32, "rcu");
+                        snprintf(v[1], 32, "%s", BENCH_BACKEND);
+                        snprintf(v[2], 32, "%s", background ? "background" : "inline");
+                        snprintf(v[3], 32, "%s", m == RCU_BENCH_COPY ? "copy" : "lock");
+                        snprintf(v[4], 32, "%s", rcu_bench_update_names[update_kind]);
+                        snprintf(v[5], 32, "%d", readers.vals[r]);
+                        snprintf(v[6], 32, "%d", writers.vals[w]);
+                        snprintf(v[7], 32, "%zu", payload_size);
+                        snprintf(v[8], 32, "%d", run);
+                        snprintf(v[9], 32, "%.6f", seconds);
+                        snprintf(v[10], 32, "%lu", reads);
+                        snprintf(v[11], 32, "%lu", updates);
+                        snprintf(v[12], 32, "%.0f", (double)reads / seconds);
+                        snprintf(v[13], 32, "%.0f", (double)updates / seconds);
+
+                        const char *values[14];
+                        for (int i = 0; i < nfields; i++)
+                            values[i] = v[i];
+                        bench_output_row(&out, nfields, names, values);
+                    }
+                }
+            }
+        }
+    }
+
+    bench_output_end(&out);
+    atm_reclaimer_stop();
+    return 0;
+}
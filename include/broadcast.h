@@ -0,0 +1,45 @@
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// Single producer ring where every consumer sees every item. The producer owns one sequence and each
+// consumer owns a cursor, the producer only overwrites a slot once the slowest cursor has moved past it.
+//
+// Items are owned by the ring and must come from malloc, the producer frees an item when it reuses its
+// slot. An item handed to a consumer stays valid until that consumer's next read or leave, so consumers
+// share one pointer per item instead of each getting a copy.
+
+struct broadcast_cursor {
+    // published to the producer, every position before seq has been released by this consumer
+    _Alignas(ATM_CACHE_LINE) _Atomic size_t seq;
+    // consumer private, the next position to read and the consumers last view of tail
+    size_t next;
+    size_t cached_tail;
+};
+
+typedef struct {
+    void **slots;
+    size_t mask;
+    struct broadcast_cursor *cursors;
+    size_t ncursors;
+    // producer line, tail is published to the consumers and cached_min is the producers last view of the slowest cursor
+    _Alignas(ATM_CACHE_LINE) _Atomic size_t tail;
+    size_t cached_min;
+} atm_broadcast;
+
+void atm_broadcast_init(atm_broadcast *, size_t, size_t);
+size_t atm_broadcast_capacity(atm_broadcast *);
+bool atm_broadcast_try_publish(atm_broadcast *, void *);
+size_t atm_broadcast_publish_bulk(atm_broadcast *, void **, size_t);
+void *atm_broadcast_try_read(atm_broadcast *, size_t);
+size_t atm_broadcast_read_bulk(atm_broadcast *, size_t, void **, size_t);
+void atm_broadcast_leave(atm_broadcast *, size_t);
+void free_atm_broadcast(atm_broadcast *);
+void free_atm_broadcast_auto(atm_broadcast *);
+
+#endif
@@ -0,0 +1,39 @@
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// Chase-Lev work stealing deque. One owner thread pushes and pops at the bottom in LIFO order, any
+// number of thieves steal from the top in FIFO order. The owner grows the array when it fills, the
+// old array is retired through the reclamation backend since thieves may still be reading it.
+
+struct deque_array {
+    long size;
+    // owner private chain of retired arrays
+    struct deque_array *prev;
+    unsigned long retire_epoch;
+    void *_Atomic slots[];
+};
+
+typedef struct {
+    // thieves line
+    _Alignas(ATM_CACHE_LINE) _Atomic long top;
+    // owner line, thieves only read it
+    _Alignas(ATM_CACHE_LINE) _Atomic long bottom;
+    struct deque_array *_Atomic array;
+    struct deque_array *retired;
+} atm_deque;
+
+void atm_deque_init(atm_deque *, size_t);
+void atm_deque_push(atm_deque *, void *);
+void *atm_deque_pop(atm_deque *);
+void *atm_deque_steal(atm_deque *);
+size_t atm_deque_size(atm_deque *);
+void free_atm_deque(atm_deque *);
+void free_atm_deque_auto(atm_deque *);
+
+#endif
@@ -0,0 +1,31 @@
+#include <stdbool.h>
+#ifndef EBR_H
+#define EBR_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// number of retirements a thread makes between attempts to advance the epoch and reclaim
+#ifndef ATM_EBR_RECLAIM_INTERVAL
+#define ATM_EBR_RECLAIM_INTERVAL 64
+#endif
+
+// per thread epoch slot, each one sits on its own cache line so readers never share a written line
+struct ebr_thread {
+    _Alignas(ATM_CACHE_LINE) _Atomic unsigned long epoch;
+    unsigned int nesting;
+    unsigned int retired;
+    _Atomic bool in_use;
+    struct ebr_thread *next;
+};
+
+void atm_ebr_enter(void);
+void atm_ebr_exit(void);
+unsigned long atm_ebr_epoch(void);
+unsigned long atm_ebr_retire_epoch(void);
+bool atm_ebr_is_safe(unsigned long);
+bool atm_ebr_try_advance(void);
+bool atm_ebr_tick(unsigned int);
+
+#endif
@@ -0,0 +1,62 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "deque.h"
+#include "queue.h"
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// number of rounds an idle worker looks for work before parking
+#ifndef ATM_EXECUTOR_IDLE_SPINS
+#define ATM_EXECUTOR_IDLE_SPINS 64
+#endif
+
+// rounds a thread outside the executor checks a group it waits on before parking
+#ifndef ATM_EXECUTOR_WAIT_SPINS
+#define ATM_EXECUTOR_WAIT_SPINS 64
+#endif
+
+// Thread pool over per worker work stealing deques. Tasks submitted from a worker go onto its own
+// deque and are usually run by the same worker while still cache warm, tasks submitted from any
+// other thread go through a shared injection queue. A worker runs its own tasks newest first, then
+// takes from the injection queue, then steals the oldest task of a random other worker.
+//
+// Tasks can be counted against a group, waiting on the group returns once all of them have run.
+// A worker waiting on a group runs other tasks in the meantime, so tasks may wait on groups too. Any
+// other thread parks until the group's last task has run.
+
+struct atm_task_group {
+    // tasks still to run, the top bit is set once a thread outside the executor parks on the group
+    _Atomic unsigned int pending;
+};
+
+struct executor_worker {
+    _Alignas(ATM_CACHE_LINE) atm_deque deque;
+    pthread_t thread;
+    struct atm_executor *ex;
+};
+
+typedef struct atm_executor {
+    struct executor_worker *workers;
+    size_t nworkers;
+    atm_queue injection;
+    // idle workers park on wake, wake_seq changes under the lock whenever one may have work
+    _Alignas(ATM_CACHE_LINE) _Atomic unsigned int sleepers;
+    _Atomic unsigned int wake_seq;
+    _Atomic bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} atm_executor;
+
+bool atm_executor_init(atm_executor *, size_t);
+void atm_task_group_init(struct atm_task_group *);
+void atm_executor_submit(atm_executor *, struct atm_task_group *, void (*)(void *), void *);
+void atm_executor_wait(atm_executor *, struct atm_task_group *);
+void free_atm_executor(atm_executor *);
+void free_atm_executor_auto(atm_executor *);
+
+#endif
@@ -0,0 +1,43 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include "reclaimer.h"
+#ifndef FAA_QUEUE_H
+#define FAA_QUEUE_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// number of items each segment of an atm_faa_queue holds
+#ifndef ATM_FAA_SEGMENT_SIZE
+#define ATM_FAA_SEGMENT_SIZE 1024
+#endif
+
+// Unbounded MPMC queue built from linked fixed size segments. Producers and consumers claim slots
+// with a fetch_add on the segment's indices instead of retrying a CAS, so contention costs one
+// atomic add per operation rather than a storm of failed CASes. Only filling a segment allocates.
+
+struct faa_segment {
+    _Alignas(ATM_CACHE_LINE) _Atomic size_t deq_idx;
+    _Alignas(ATM_CACHE_LINE) _Atomic size_t enq_idx;
+    _Alignas(ATM_CACHE_LINE) struct faa_segment *_Atomic next;
+    struct faa_segment *retired_next;
+    unsigned long retire_epoch;
+    void *_Atomic items[ATM_FAA_SEGMENT_SIZE];
+};
+
+typedef struct {
+    _Alignas(ATM_CACHE_LINE) struct faa_segment *_Atomic head;
+    _Alignas(ATM_CACHE_LINE) struct faa_segment *_Atomic tail;
+    _Alignas(ATM_CACHE_LINE) struct faa_segment *_Atomic retired;
+    struct atm_deferred deferred;
+} atm_faa_queue;
+
+void atm_faa_queue_init(atm_faa_queue *);
+void atm_faa_queue_enqueue(atm_faa_queue *, void *);
+void *atm_faa_queue_dequeue(atm_faa_queue *);
+void atm_faa_queue_reclaim(atm_faa_queue *);
+void free_atm_faa_queue(atm_faa_queue *);
+void free_atm_faa_queue_auto(atm_faa_queue *);
+
+#endif
@@ -0,0 +1,44 @@
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef HP_H
+#define HP_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// hazard slots available to each thread, nested operations stack their slots on top of each other
+#ifndef ATM_HP_SLOTS
+#define ATM_HP_SLOTS 8
+#endif
+
+// number of retirements a thread makes between scans of the hazard slots
+#ifndef ATM_HP_RECLAIM_INTERVAL
+#define ATM_HP_RECLAIM_INTERVAL 64
+#endif
+
+// per thread hazard slots, each thread's slots start on their own cache line
+struct hp_thread {
+    _Alignas(ATM_CACHE_LINE) void *_Atomic hazards[ATM_HP_SLOTS];
+    unsigned int depth;
+    unsigned int retired;
+    _Atomic bool in_use;
+    struct hp_thread *next;
+};
+
+// sorted copy of every published hazard, taken by a reclaiming thread
+struct hp_snapshot {
+    void **hazards;
+    size_t n;
+};
+
+unsigned int atm_hp_enter(unsigned int);
+void atm_hp_exit(unsigned int, unsigned int);
+void atm_hp_pop(unsigned int);
+void *atm_hp_protect(unsigned int, void *_Atomic *);
+void atm_hp_hold(unsigned int, void *);
+bool atm_hp_tick(unsigned int);
+void atm_hp_snapshot(struct hp_snapshot *);
+bool atm_hp_snapshot_contains(struct hp_snapshot *, void *);
+
+#endif
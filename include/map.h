@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "stats.h"
+#include "reclaimer.h"
+#ifndef MAP_H
+#define MAP_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// buckets in a new map, tables double from there
+#ifndef ATM_MAP_INITIAL_BUCKETS
+#define ATM_MAP_INITIAL_BUCKETS 16
+#endif
+
+// average chain length that starts a resize
+#ifndef ATM_MAP_LOAD_FACTOR
+#define ATM_MAP_LOAD_FACTOR 2
+#endif
+
+// old buckets each put or remove moves across while a resize is in progress
+#ifndef ATM_MAP_MIGRATE_STEP
+#define ATM_MAP_MIGRATE_STEP 8
+#endif
+
+// stripes the key count is spread over, threads beyond this share a stripe
+#ifndef ATM_MAP_COUNT_STRIPES
+#define ATM_MAP_COUNT_STRIPES 16
+#endif
+
+// a thread sums the count stripes against the load factor once its stripe moves this many inserts on
+#ifndef ATM_MAP_COUNT_CHECK
+#define ATM_MAP_COUNT_CHECK 8
+#endif
+
+// Hash map from integer keys to values with lock free readers. Each bucket is a singly linked list,
+// readers walk it inside a reclamation section and never lock or write anything shared. Writers lock
+// only the bucket they change and replace nodes rather than editing them, so a put or remove costs
+// O(1) whatever the size of the map. Replaced and removed nodes, and their values, are retired
+// through the reclamation backend.
+//
+// Growing allocates a table twice the size and links the old one behind it. The old buckets are
+// moved over a few at a time by later writers, readers look in whichever table holds the key's bucket
+// and are never held up by a resize. Values are owned by the map and freed once unreachable.
+
+struct map_node {
+    uint64_t key;
+    void *value;
+    // the low bit is set once the node has been unlinked, readers part way past it start over
+    struct map_node *_Atomic next;
+    struct map_node *_Atomic free_next;
+    unsigned long retire_epoch;
+    // shared with the copies a resize makes of the node, NULL while this node is the value's only reference
+    _Atomic unsigned int *value_refs;
+};
+
+struct map_bucket {
+    struct map_node *_Atomic head;
+    _Atomic bool lock;
+};
+
+struct map_table {
+    size_t mask;
+    // the table being moved into this one, NULL once every bucket has moved
+    struct map_table *_Atomic prev;
+    _Atomic size_t migrate_next;
+    _Atomic size_t migrate_done;
+    struct map_table *_Atomic free_next;
+    unsigned long retire_epoch;
+    struct map_bucket buckets[];
+};
+
+struct map_count_stripe {
+    _Alignas(ATM_CACHE_LINE) _Atomic long count;
+};
+
+typedef struct {
+    // readers line, only written when a resize swaps in a bigger table
+    _Alignas(ATM_CACHE_LINE) struct map_table *_Atomic table;
+    void *(*cpy)(void*);
+    // writers line
+    _Alignas(ATM_CACHE_LINE) struct map_node *_Atomic retired;
+    struct map_table *_Atomic retired_tables;
+    struct atm_deferred deferred;
+    // each thread counts its inserts and removes into its own stripe, the size is their sum
+    struct map_count_stripe counts[ATM_MAP_COUNT_STRIPES];
+#ifdef ATM_STATS
+    struct atm_stats_stripe stats[ATM_STATS_STRIPES];
+#endif
+} atm_map;
+
+void atm_map_init(atm_map *, void *(*cpy)(void*));
+void *atm_map_get(atm_map *, uint64_t);
+const void *atm_map_read_lock(atm_map *, uint64_t);
+void atm_map_read_unlock(atm_map *);
+bool atm_map_contains(atm_map *, uint64_t);
+void atm_map_put(atm_map *, uint64_t, void *);
+bool atm_map_remove(atm_map *, uint64_t);
+size_t atm_map_size(atm_map *);
+void atm_map_reclaim(atm_map *);
+void atm_map_stats(atm_map *, struct atm_stats *);
+void free_atm_map(atm_map *);
+void free_atm_map_auto(atm_map *);
+
+#endif
@@ -0,0 +1,32 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include "queue.h"
+#ifndef MULTI_QUEUE_H
+#define MULTI_QUEUE_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// Relaxed FIFO container spreading items over several atm_queue shards, so threads mostly contend
+// on different heads and tails. Items from one producer come out in order only when they land on
+// the same shard and are taken by the same consumer, there is no global order across shards.
+
+struct multi_queue_shard {
+    _Alignas(ATM_CACHE_LINE) atm_queue q;
+    // approximate number of items in the shard, only used to pick between candidate shards
+    _Alignas(ATM_CACHE_LINE) _Atomic long size;
+};
+
+typedef struct {
+    struct multi_queue_shard *shards;
+    size_t nshards;
+} atm_multi_queue;
+
+void atm_multi_queue_init(atm_multi_queue *, size_t);
+void atm_multi_queue_enqueue(atm_multi_queue *, void *);
+void *atm_multi_queue_dequeue(atm_multi_queue *);
+void free_atm_multi_queue(atm_multi_queue *);
+void free_atm_multi_queue_auto(atm_multi_queue *);
+
+#endif
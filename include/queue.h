@@ -1,36 +1,50 @@
 #include <stdbool.h>
+#include <stddef.h>
+#include "stats.h"
+#include "reclaimer.h"
 #ifndef QUEUE_H
 #define QUEUE_H
 
+// number of dequeue attempts atm_queue_dequeue_wait makes before parking
+#ifndef ATM_QUEUE_WAIT_SPINS
+#define ATM_QUEUE_WAIT_SPINS 256
+#endif
+
 struct queue_node {
     void *_Atomic data;
     struct queue_node *_Atomic next;
+    struct queue_node *_Atomic free_next;
+    unsigned long retire_epoch;
 };
 
 void queue_node_init(struct queue_node *, void *);
 void free_queue_node(struct queue_node *);
-
-struct queue_epoch_node {
-    struct queue_node *data;
-    struct queue_epoch_node *next;
-};
-
-void queue_epoch_node_init(struct queue_epoch_node *, struct queue_node *);
-void free_queue_epoch_node(struct queue_epoch_node *restrict);
+void free_queue_node_list(struct queue_node *);
 
 typedef struct {
-    _Atomic unsigned int state;
-    _Atomic bool epoch_flag;
     struct queue_node *_Atomic head;
     struct queue_node *_Atomic tail;
-    struct queue_epoch_node *_Atomic cur_epoch_stack;
-    struct queue_epoch_node *_Atomic final_epoch_stack;
+    struct queue_node *_Atomic retired;
+    struct queue_node *_Atomic free_nodes;
+    _Atomic unsigned int waiters;
+    _Atomic unsigned int wake_seq;
+    struct atm_deferred deferred;
+#ifdef ATM_STATS
+    struct atm_stats_stripe stats[ATM_STATS_STRIPES];
+#endif
 } atm_queue;
 
 void atm_queue_init(atm_queue *);
 void *atm_queue_dequeue(atm_queue *);
 void atm_queue_enqueue(atm_queue *, void *);
+void atm_queue_enqueue_bulk(atm_queue *, void **, size_t);
+size_t atm_queue_dequeue_bulk(atm_queue *, void **, size_t);
+void *atm_queue_dequeue_wait(atm_queue *, long long);
 void atm_queue_push_epoch(atm_queue *, struct queue_node *);
+void atm_queue_reclaim(atm_queue *);
+struct queue_node *atm_queue_alloc_node(atm_queue *, void *);
+void atm_queue_release_nodes(atm_queue *, struct queue_node *, struct queue_node *);
+void atm_queue_stats(atm_queue *, struct atm_stats *);
 void free_atm_queue(atm_queue *);
 void free_atm_queue_auto(atm_queue *);
 
@@ -1,40 +1,56 @@
 #include <stdbool.h>
+#include "stats.h"
+#include "reclaimer.h"
 #ifndef RCU_H
 #define RCU_H
 // #include <stdatomic.h>
 
-typedef struct {
-    _Atomic unsigned int ref_count;
+typedef struct rcunode {
     void *data_ptr;
+    struct rcunode *next;
+    unsigned long retire_epoch;
+    unsigned long version;
 } rcunode_t;
 
+// a pending rcu_update_combined call, it lives on the caller's stack until the combiner marks it done
+struct rcu_request {
+    void (*mutate)(void*, void*);
+    void *ctx;
+    struct rcu_request *next;
+    _Atomic int status;
+};
+
 void rcunode_init(rcunode_t *, void *);
-void rcunode_inc_ref_count(rcunode_t *);
 void *rcunode_cpy(rcunode_t *, void *(*cpy)(void*));
 void free_rcunode(rcunode_t *);
-
-struct rcu_stack_node {
-    rcunode_t *data;
-    struct rcu_stack_node *next;
-};
-
-void rcu_stack_node_init(struct rcu_stack_node *, rcunode_t *);
-void free_rcu_stack_node(struct rcu_stack_node *restrict);
+void free_rcunode_stack(rcunode_t *);
 
 typedef struct {
-    _Atomic unsigned int state;
-    _Atomic bool epoch_flag;
     rcunode_t *_Atomic data;
-    struct rcu_stack_node *_Atomic cur_epoch_stack;
-    struct rcu_stack_node *_Atomic final_epoch_stack;
+    rcunode_t *_Atomic retired;
     void *(*cpy)(void*);
+    struct rcu_request *_Atomic requests;
+    _Atomic bool combining;
+    struct atm_deferred deferred;
+#ifdef ATM_STATS
+    struct atm_stats_stripe stats[ATM_STATS_STRIPES];
+#endif
 } rcu_t;
 
 void rcu_init(rcu_t *, void *(*cpy)(void*));
 void rcu_init_with(rcu_t *, void *(*cpy)(void*), void *data);
 void *rcu_read(rcu_t *);
+void *rcu_read_versioned(rcu_t *, unsigned long *);
+unsigned long rcu_version(rcu_t *);
+const void *rcu_read_lock(rcu_t *);
+void rcu_read_unlock(rcu_t *);
 void rcu_update(rcu_t *, void *);
+bool rcu_update_fn(rcu_t *, void (*mutate)(void*, void*), void *);
+bool rcu_update_if(rcu_t *, void *, unsigned long);
+bool rcu_update_combined(rcu_t *, void (*mutate)(void*, void*), void *);
 void rcu_push(rcu_t *, rcunode_t *);
+void rcu_reclaim(rcu_t *);
+void rcu_stats(rcu_t *, struct atm_stats *);
 void free_rcu(rcu_t *);
 
 #endif
\ No newline at end of file
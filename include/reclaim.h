@@ -0,0 +1,138 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#ifndef RECLAIM_H
+#define RECLAIM_H
+
+// Selects the memory reclamation backend the collections are built against. Epoch based reclamation
+// is the default, defining ATM_RECLAIM_HP builds against hazard pointers instead.
+//
+// An operation enters with the number of pointers it needs protected at once and receives a guard.
+// Sections must be exited in the reverse order they were entered, atm_reclaim_exit_last leaves the
+// innermost one for callers that can't keep the guard around.
+// Under hazard pointers each protected pointer occupies one slot, under epochs entering pins the
+// current epoch and protect is a plain acquire load. Retired nodes are tagged with atm_reclaim_tag,
+// and a reclaiming thread checks each one with atm_reclaim_is_safe between scan begin and end.
+
+#ifdef ATM_RECLAIM_HP
+
+#include "hp.h"
+
+struct reclaim_scan {
+    struct hp_snapshot snap;
+};
+
+static inline unsigned int atm_reclaim_enter(unsigned int nslots)
+{
+    return atm_hp_enter(nslots);
+}
+
+static inline void atm_reclaim_exit(unsigned int guard, unsigned int nslots)
+{
+    atm_hp_exit(guard, nslots);
+}
+
+static inline void atm_reclaim_exit_last(unsigned int nslots)
+{
+    atm_hp_pop(nslots);
+}
+
+static inline void *atm_reclaim_protect(unsigned int guard, unsigned int i, void *_Atomic *src)
+{
+    return atm_hp_protect(guard + i, src);
+}
+
+static inline void atm_reclaim_hold(unsigned int guard, unsigned int i, void *ptr)
+{
+    atm_hp_hold(guard + i, ptr);
+}
+
+static inline unsigned long atm_reclaim_tag(void)
+{
+    return 0;
+}
+
+static inline bool atm_reclaim_tick(unsigned int nretired)
+{
+    return atm_hp_tick(nretired);
+}
+
+static inline void atm_reclaim_scan_begin(struct reclaim_scan *scan)
+{
+    atm_hp_snapshot(&(scan->snap));
+}
+
+static inline bool atm_reclaim_is_safe(struct reclaim_scan *scan, void *ptr, unsigned long tag)
+{
+    return !atm_hp_snapshot_contains(&(scan->snap), ptr);
+}
+
+static inline void atm_reclaim_scan_end(struct reclaim_scan *scan)
+{
+}
+
+#else
+
+#include "ebr.h"
+
+struct reclaim_scan {
+    unsigned long epoch;
+};
+
+static inline unsigned int atm_reclaim_enter(unsigned int nslots)
+{
+    atm_ebr_enter();
+    return 0;
+}
+
+static inline void atm_reclaim_exit(unsigned int guard, unsigned int nslots)
+{
+    atm_ebr_exit();
+}
+
+static inline void atm_reclaim_exit_last(unsigned int nslots)
+{
+    atm_ebr_exit();
+}
+
+static inline void *atm_reclaim_protect(unsigned int guard, unsigned int i, void *_Atomic *src)
+{
+    return atomic_load_explicit(src, memory_order_acquire);
+}
+
+static inline void atm_reclaim_hold(unsigned int guard, unsigned int i, void *ptr)
+{
+}
+
+static inline unsigned long atm_reclaim_tag(void)
+{
+    return atm_ebr_retire_epoch();
+}
+
+static inline bool atm_reclaim_tick(unsigned int nretired)
+{
+    // move the epoch along whenever this thread has retired enough to be worth a reclaim
+    if (!atm_ebr_tick(nretired))
+        return false;
+
+    atm_ebr_try_advance();
+    return true;
+}
+
+static inline void atm_reclaim_scan_begin(struct reclaim_scan *scan)
+{
+    scan->epoch = atm_ebr_epoch();
+}
+
+static inline bool atm_reclaim_is_safe(struct reclaim_scan *scan, void *ptr, unsigned long tag)
+{
+    // same rule as atm_ebr_is_safe, against the epoch read once at the start of the scan
+    return scan->epoch >= tag + 2;
+}
+
+static inline void atm_reclaim_scan_end(struct reclaim_scan *scan)
+{
+}
+
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#ifndef RECLAIMER_H
+#define RECLAIMER_H
+
+// Optional background reclamation. While the reclaimer thread is running, a collection whose
+// retirements would trigger a reclaim pass hands the pass to the reclaimer instead, so the
+// dequeuing or updating thread never walks the retired stack or calls free itself. When it isn't
+// running every collection reclaims inline as before.
+//
+// Each collection embeds one atm_deferred describing its reclaim pass. A deferred item is queued at
+// most once at a time, deferring it again while the reclaimer is running it schedules one more pass.
+// A collection must cancel its item before it is freed, flushing instead waits for a pending pass to run.
+
+struct atm_deferred {
+    void (*fn)(void *);
+    void *arg;
+    struct atm_deferred *next;
+    _Atomic int state;
+};
+
+void atm_deferred_init(struct atm_deferred *, void (*fn)(void *), void *);
+bool atm_reclaimer_start(void);
+void atm_reclaimer_stop(void);
+bool atm_reclaimer_running(void);
+bool atm_reclaimer_defer(struct atm_deferred *);
+void atm_reclaimer_cancel(struct atm_deferred *);
+void atm_reclaimer_flush(struct atm_deferred *);
+
+#endif
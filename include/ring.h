@@ -0,0 +1,29 @@
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef RING_H
+#define RING_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+struct ring_slot {
+    _Atomic size_t seq;
+    void *data;
+};
+
+typedef struct {
+    struct ring_slot *slots;
+    size_t mask;
+    _Alignas(ATM_CACHE_LINE) _Atomic size_t head;
+    _Alignas(ATM_CACHE_LINE) _Atomic size_t tail;
+} atm_ring;
+
+void atm_ring_init(atm_ring *, size_t);
+size_t atm_ring_capacity(atm_ring *);
+bool atm_ring_try_enqueue(atm_ring *, void *);
+void *atm_ring_try_dequeue(atm_ring *);
+void free_atm_ring(atm_ring *);
+void free_atm_ring_auto(atm_ring *);
+
+#endif
@@ -0,0 +1,41 @@
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// largest value in bytes an atm_seqlock can hold inline
+#ifndef ATM_SEQLOCK_SIZE
+#define ATM_SEQLOCK_SIZE 64
+#endif
+
+// number of attempts a reader or writer spins on an in progress write before yielding
+#ifndef ATM_SEQLOCK_SPINS
+#define ATM_SEQLOCK_SPINS 64
+#endif
+
+#define ATM_SEQLOCK_WORDS ((ATM_SEQLOCK_SIZE + sizeof(unsigned long) - 1) / sizeof(unsigned long))
+
+// Small object alternative to rcu_t. The value lives inline next to a sequence counter, writers bump
+// the counter to odd, write and bump it back to even, and readers retry whenever the counter moved
+// under them. Updates never allocate and nothing is retired. The value is copied through atomic
+// words so a reader racing a writer sees a torn copy it then throws away, never a data race.
+// The version matches rcu_t, 1 for the first published value and one more for every update after.
+
+typedef struct {
+    _Alignas(ATM_CACHE_LINE) _Atomic unsigned long seq;
+    size_t size;
+    _Atomic unsigned long words[ATM_SEQLOCK_WORDS];
+} atm_seqlock;
+
+bool atm_seqlock_init(atm_seqlock *, size_t, const void *);
+void atm_seqlock_read(atm_seqlock *, void *);
+unsigned long atm_seqlock_read_versioned(atm_seqlock *, void *);
+unsigned long atm_seqlock_version(atm_seqlock *);
+void atm_seqlock_update(atm_seqlock *, const void *);
+bool atm_seqlock_update_if(atm_seqlock *, const void *, unsigned long);
+
+#endif
@@ -0,0 +1,42 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifndef SHM_QUEUE_H
+#define SHM_QUEUE_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// Michael-Scott queue that lives entirely inside a caller provided region, e.g. a shm_open or MAP_SHARED
+// mapping, so processes mapping the region at different addresses can share it. Every link is a node
+// index tagged with a counter against ABA, and nodes come from a fixed pool in the region that is never
+// unmapped while in use, so no reclamation scheme is needed. Items are copied in and out by value.
+//
+// A process dying in the middle of an operation can lose a node from the pool, it does not corrupt the queue.
+
+struct shm_queue_node {
+    // tagged index of the next node, in the queue or on the free list
+    _Atomic uint64_t next;
+    _Atomic uint64_t words[];
+};
+
+typedef struct {
+    // written last by init, attach refuses a region until it sees the magic
+    _Atomic uint32_t magic;
+    uint32_t nodes;
+    uint32_t node_size;
+    uint32_t item_size;
+    _Alignas(ATM_CACHE_LINE) _Atomic uint64_t head;
+    _Alignas(ATM_CACHE_LINE) _Atomic uint64_t tail;
+    _Alignas(ATM_CACHE_LINE) _Atomic uint64_t free_nodes;
+} atm_shm_queue;
+
+size_t atm_shm_queue_region_size(size_t, size_t);
+bool atm_shm_queue_init(atm_shm_queue *, size_t, size_t);
+bool atm_shm_queue_attach(atm_shm_queue *, size_t, size_t);
+size_t atm_shm_queue_capacity(atm_shm_queue *);
+bool atm_shm_queue_try_enqueue(atm_shm_queue *, const void *);
+bool atm_shm_queue_try_dequeue(atm_shm_queue *, void *);
+
+#endif
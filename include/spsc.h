@@ -0,0 +1,30 @@
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef SPSC_H
+#define SPSC_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+typedef struct {
+    void **slots;
+    size_t mask;
+    // consumer line, head is published to the producer and cached_tail is the consumers last view of tail
+    _Alignas(ATM_CACHE_LINE) _Atomic size_t head;
+    size_t cached_tail;
+    // producer line, tail is published to the consumer and cached_head is the producers last view of head
+    _Alignas(ATM_CACHE_LINE) _Atomic size_t tail;
+    size_t cached_head;
+} atm_spsc;
+
+void atm_spsc_init(atm_spsc *, size_t);
+size_t atm_spsc_capacity(atm_spsc *);
+bool atm_spsc_try_enqueue(atm_spsc *, void *);
+void *atm_spsc_try_dequeue(atm_spsc *);
+size_t atm_spsc_enqueue_bulk(atm_spsc *, void **, size_t);
+size_t atm_spsc_dequeue_bulk(atm_spsc *, void **, size_t);
+void free_atm_spsc(atm_spsc *);
+void free_atm_spsc_auto(atm_spsc *);
+
+#endif
@@ -0,0 +1,62 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include "stats.h"
+#include "reclaimer.h"
+#ifndef STACK_H
+#define STACK_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// number of exchanger slots a push and pop that both lost the race on top can meet in
+#ifndef ATM_STACK_ELIMINATION_SLOTS
+#define ATM_STACK_ELIMINATION_SLOTS 8
+#endif
+
+// how long a push waits in an exchanger slot for a pop before going back to top
+#ifndef ATM_STACK_ELIMINATION_SPINS
+#define ATM_STACK_ELIMINATION_SPINS 128
+#endif
+
+// Treiber stack with an elimination array. A push whose CAS on top fails parks its item in a random
+// exchanger slot for a while, and a pop whose CAS fails looks in a random slot before retrying, so a
+// push and pop colliding under contention cancel out without touching top. Popped nodes are retired
+// through the reclamation backend and recycled through a node pool, as in atm_queue.
+
+struct stack_node {
+    void *data;
+    struct stack_node *_Atomic next;
+    struct stack_node *_Atomic free_next;
+    unsigned long retire_epoch;
+};
+
+struct stack_exchanger {
+    // NULL when free, otherwise the item a waiting push is offering
+    _Alignas(ATM_CACHE_LINE) void *_Atomic item;
+};
+
+typedef struct {
+    _Alignas(ATM_CACHE_LINE) struct stack_node *_Atomic top;
+    _Alignas(ATM_CACHE_LINE) struct stack_node *_Atomic retired;
+    struct stack_node *_Atomic free_nodes;
+    struct stack_exchanger elimination[ATM_STACK_ELIMINATION_SLOTS];
+    // set from the defaults by atm_stack_init and may be changed before the stack is shared. With
+    // eliminate_first a push or pop tries the exchanger before top, mostly to exercise it in tests
+    unsigned int elimination_spins;
+    bool eliminate_first;
+    struct atm_deferred deferred;
+#ifdef ATM_STATS
+    struct atm_stats_stripe stats[ATM_STATS_STRIPES];
+#endif
+} atm_stack;
+
+void atm_stack_init(atm_stack *);
+void atm_stack_push(atm_stack *, void *);
+void *atm_stack_pop(atm_stack *);
+void atm_stack_reclaim(atm_stack *);
+void atm_stack_stats(atm_stack *, struct atm_stats *);
+void free_atm_stack(atm_stack *);
+void free_atm_stack_auto(atm_stack *);
+
+#endif
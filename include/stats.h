@@ -0,0 +1,52 @@
+#include <stdatomic.h>
+#ifndef STATS_H
+#define STATS_H
+
+#ifndef ATM_CACHE_LINE
+#define ATM_CACHE_LINE 64
+#endif
+
+// number of counter stripes each collection carries, threads beyond this share a stripe
+#ifndef ATM_STATS_STRIPES
+#define ATM_STATS_STRIPES 16
+#endif
+
+// Optional contention and reclamation counters. They are only maintained when the library is built
+// with ATM_STATS defined, otherwise ATM_STAT_ADD compiles away and every snapshot reads as zero.
+// Each thread counts into its own cache line sized stripe, so counting never bounces a line between
+// cores, and a snapshot sums the stripes.
+
+enum atm_stat {
+    ATM_STAT_CAS_RETRIES,
+    ATM_STAT_EMPTY_DEQUEUES,
+    ATM_STAT_RETIRED,
+    ATM_STAT_FREED,
+    ATM_STAT_ELIMINATIONS,
+    ATM_STAT_COUNT
+};
+
+struct atm_stats {
+    unsigned long cas_retries;
+    unsigned long empty_dequeues;
+    unsigned long epoch_advances;
+    unsigned long retired;
+    unsigned long freed;
+    unsigned long backlog;
+    unsigned long eliminations;
+};
+
+struct atm_stats_stripe {
+    _Alignas(ATM_CACHE_LINE) _Atomic unsigned long counters[ATM_STAT_COUNT];
+};
+
+void atm_stats_init(struct atm_stats_stripe *);
+void atm_stats_add(struct atm_stats_stripe *, enum atm_stat, unsigned long);
+void atm_stats_collect(struct atm_stats_stripe *, struct atm_stats *);
+
+#ifdef ATM_STATS
+#define ATM_STAT_ADD(stripes, stat, n) atm_stats_add((stripes), (stat), (n))
+#else
+#define ATM_STAT_ADD(stripes, stat, n) ((void)(n))
+#endif
+
+#endif
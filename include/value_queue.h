@@ -0,0 +1,66 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "reclaimer.h"
+#ifndef VALUE_QUEUE_H
+#define VALUE_QUEUE_H
+
+// Unbounded queue whose nodes hold a fixed size value inline rather than a pointer to it, so small
+// messages need neither a payload allocation nor a second load to reach them. Values are copied in
+// on enqueue and copied out on dequeue. ATM_QUEUE_DEFINE generates a typed wrapper for one element type.
+
+struct value_node {
+    struct value_node *_Atomic next;
+    struct value_node *_Atomic free_next;
+    unsigned long retire_epoch;
+    _Alignas(max_align_t) unsigned char value[];
+};
+
+typedef struct {
+    struct value_node *_Atomic head;
+    struct value_node *_Atomic tail;
+    struct value_node *_Atomic retired;
+    struct value_node *_Atomic free_nodes;
+    size_t size;
+    struct atm_deferred deferred;
+} atm_value_queue;
+
+void atm_value_queue_init(atm_value_queue *, size_t);
+void atm_value_queue_enqueue(atm_value_queue *, const void *);
+bool atm_value_queue_try_dequeue(atm_value_queue *, void *);
+void atm_value_queue_reclaim(atm_value_queue *);
+void free_atm_value_queue(atm_value_queue *);
+void free_atm_value_queue_auto(atm_value_queue *);
+
+#define ATM_QUEUE_DEFINE(name, T)                                                   \
+    typedef struct {                                                                \
+        atm_value_queue q;                                                          \
+    } name;                                                                         \
+                                                                                    \
+    static inline void name##_init(name *q)                                         \
+    {                                                                               \
+        atm_value_queue_init(&(q->q), sizeof(T));                                   \
+    }                                                                               \
+                                                                                    \
+    static inline void name##_enqueue(name *q, T value)                             \
+    {                                                                               \
+        atm_value_queue_enqueue(&(q->q), &value);                                   \
+    }                                                                               \
+                                                                                    \
+    static inline bool name##_try_dequeue(name *q, T *out)                          \
+    {                                                                               \
+        return atm_value_queue_try_dequeue(&(q->q), out);                           \
+    }                                                                               \
+                                                                                    \
+    static inline void free_##name(name *q)                                         \
+    {                                                                               \
+        free_atm_value_queue_auto(&(q->q));                                         \
+        free(q);                                                                    \
+    }                                                                               \
+                                                                                    \
+    static inline void free_##name##_auto(name *q)                                  \
+    {                                                                               \
+        free_atm_value_queue_auto(&(q->q));                                         \
+    }
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "broadcast.h"
+
+void atm_broadcast_init(atm_broadcast *b, size_t capacity, size_t nconsumers)
+{
+    // round capacity up to a power of two so positions can be masked into slot indices
+    size_t cap = 2;
+    while (cap < capacity)
+        cap <<= 1;
+
+    b->slots = calloc(cap, sizeof(void*));
+    b->mask = cap - 1;
+
+    // every cursor sits on its own line so consumers never share one with each other or the producer
+    b->ncursors = nconsumers;
+    b->cursors = aligned_alloc(ATM_CACHE_LINE, (nconsumers ? nconsumers : 1) * sizeof(struct broadcast_cursor));
+    for (size_t i = 0; i < nconsumers; i++)
+    {
+        atomic_store_explicit(&(b->cursors[i].seq), 0, memory_order_relaxed);
+        b->cursors[i].next = 0;
+        b->cursors[i].cached_tail = 0;
+    }
+
+    atomic_store_explicit(&(b->tail), 0, memory_order_relaxed);
+    b->cached_min = 0;
+}
+
+size_t atm_broadcast_capacity(atm_broadcast *b)
+{
+    return b->mask + 1;
+}
+
+// producer side, only ever called from the single producer thread
+static size_t atm_broadcast_free_slots(atm_broadcast *b, size_t tail, size_t want)
+{
+    size_t cap = b->mask + 1;
+    size_t avail = cap - (tail - b->cached_min);
+    if (avail < want)
+    {
+        // only walk the cursors when our cached view of the slowest says we are full. Cursors that left sit
+        // past any real position, so with none left the producer is never held back
+        size_t min = tail;
+        for (size_t i = 0; i < b->ncursors; i++)
+        {
+            size_t seq = atomic_load_explicit(&(b->cursors[i].seq), memory_order_acquire);
+            if (seq < min)
+                min = seq;
+        }
+        b->cached_min = min;
+        avail = cap - (tail - min);
+    }
+    return avail;
+}
+
+// every cursor has released the item in this slot, free it before the slot is reused
+static void atm_broadcast_store(atm_broadcast *b, size_t pos, void *data)
+{
+    void **slot = &(b->slots[pos & b->mask]);
+    if (*slot)
+        free(*slot);
+    *slot = data;
+}
+
+bool atm_broadcast_try_publish(atm_broadcast *b, void *data)
+{
+    size_t tail = atomic_load_explicit(&(b->tail), memory_order_relaxed);
+    if (atm_broadcast_free_slots(b, tail, 1) == 0)
+        return false;
+
+    atm_broadcast_store(b, tail, data);
+    atomic_store_explicit(&(b->tail), tail + 1, memory_order_release);
+    return true;
+}
+
+size_t atm_broadcast_publish_bulk(atm_broadcast *b, void **items, size_t n)
+{
+    size_t tail = atomic_load_explicit(&(b->tail), memory_order_relaxed);
+    size_t avail = atm_broadcast_free_slots(b, tail, n);
+    if (n > avail)
+        n = avail;
+
+    // write every slot first and publish them all with one release store
+    for (size_t i = 0; i < n; i++)
+        atm_broadcast_store(b, tail + i, items[i]);
+
+    if (n)
+        atomic_store_explicit(&(b->tail), tail + n, memory_order_release);
+    return n;
+}
+
+// consumer side, only ever called from the thread owning the cursor
+static size_t atm_broadcast_used_slots(atm_broadcast *b, struct broadcast_cursor *c, size_t want)
+{
+    size_t avail = c->cached_tail - c->next;
+    if (avail < want)
+    {
+        // only touch the producers cache line when our cached view says we have caught up
+        c->cached_tail = atomic_load_explicit(&(b->tail), memory_order_acquire);
+        avail = c->cached_tail - c->next;
+    }
+    return avail;
+}
+
+// hands everything this consumer has read so far back to the producer
+static void atm_broadcast_release(struct broadcast_cursor *c)
+{
+    if (atomic_load_explicit(&(c->seq), memory_order_relaxed) != c->next)
+        atomic_store_explicit(&(c->seq), c->next, memory_order_release);
+}
+
+void *atm_broadcast_try_read(atm_broadcast *b, size_t consumer)
+{
+    struct broadcast_cursor *c = &(b->cursors[consumer]);
+
+    // release the previous item even when nothing new is there, a consumer that has caught up holds nothing back
+    atm_broadcast_release(c);
+    if (atm_broadcast_used_slots(b, c, 1) == 0)
+        return NULL;
+
+    return b->slots[c->next++ & b->mask];
+}
+
+size_t atm_broadcast_read_bulk(atm_broadcast *b, size_t consumer, void **out, size_t max)
+{
+    struct broadcast_cursor *c = &(b->cursors[consumer]);
+
+    atm_broadcast_release(c);
+    size_t avail = atm_broadcast_used_slots(b, c, max);
+    if (max > avail)
+        max = avail;
+
+    for (size_t i = 0; i < max; i++)
+        out[i] = b->slots[(c->next + i) & b->mask];
+
+    c->next += max;
+    return max;
+}
+
+void atm_broadcast_leave(atm_broadcast *b, size_t consumer)
+{
+    // a cursor past every position never gates the producer again
+    atomic_store_explicit(&(b->cursors[consumer].seq), SIZE_MAX, memory_order_release);
+}
+
+void free_atm_broadcast(atm_broadcast *b)
+{
+    free_atm_broadcast_auto(b);
+    free(b);
+}
+
+void free_atm_broadcast_auto(atm_broadcast *b)
+{
+    // free any data still held by the ring, read or not
+    for (size_t i = 0; i <= b->mask; i++)
+        if (b->slots[i])
+            free(b->slots[i]);
+
+    free(b->slots);
+    free(b->cursors);
+    b->slots = NULL;
+    b->cursors = NULL;
+}
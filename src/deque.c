@@ -0,0 +1,164 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "deque.h"
+#include "reclaim.h"
+
+// follows the C11 formulation in "Correct and Efficient Work-Stealing for Weak Memory Models"
+
+static struct deque_array *deque_array_new(long size)
+{
+    struct deque_array *a = malloc(sizeof(struct deque_array) + size * sizeof(void *));
+    a->size = size;
+    a->prev = NULL;
+    a->retire_epoch = 0;
+    return a;
+}
+
+void atm_deque_init(atm_deque *d, size_t capacity)
+{
+    // round capacity up to a power of two so positions can be masked into slot indices
+    long cap = 2;
+    while ((size_t)cap < capacity)
+        cap <<= 1;
+
+    atomic_store_explicit(&(d->top), 0, memory_order_relaxed);
+    atomic_store_explicit(&(d->bottom), 0, memory_order_relaxed);
+    atomic_store_explicit(&(d->array), deque_array_new(cap), memory_order_relaxed);
+    d->retired = NULL;
+}
+
+// owner side, frees whichever retired arrays no thief can still be reading
+static void atm_deque_reclaim(atm_deque *d)
+{
+    struct reclaim_scan scan;
+    atm_reclaim_scan_begin(&scan);
+
+    struct deque_array **link = &(d->retired);
+    while (*link)
+    {
+        struct deque_array *a = *link;
+        if (atm_reclaim_is_safe(&scan, a, a->retire_epoch))
+        {
+            *link = a->prev;
+            free(a);
+        }
+        else
+            link = &(a->prev);
+    }
+
+    atm_reclaim_scan_end(&scan);
+}
+
+static struct deque_array *atm_deque_grow(atm_deque *d, struct deque_array *a, long top, long bottom)
+{
+    struct deque_array *neo = deque_array_new(a->size * 2);
+    for (long i = top; i < bottom; i++)
+    {
+        void *item = atomic_load_explicit(&(a->slots[i & (a->size - 1)]), memory_order_relaxed);
+        atomic_store_explicit(&(neo->slots[i & (neo->size - 1)]), item, memory_order_relaxed);
+    }
+    atomic_store_explicit(&(d->array), neo, memory_order_release);
+
+    // a thief may have loaded the old array just before the swap, keep it until it is safe
+    a->retire_epoch = atm_reclaim_tag();
+    a->prev = d->retired;
+    d->retired = a;
+    atm_deque_reclaim(d);
+
+    return neo;
+}
+
+void atm_deque_push(atm_deque *d, void *data)
+{
+    long bottom = atomic_load_explicit(&(d->bottom), memory_order_relaxed);
+    long top = atomic_load_explicit(&(d->top), memory_order_acquire);
+    struct deque_array *a = atomic_load_explicit(&(d->array), memory_order_relaxed);
+
+    if (bottom - top > a->size - 1)
+        a = atm_deque_grow(d, a, top, bottom);
+
+    // publish the slot with the new bottom, thieves acquire bottom before reading it
+    atomic_store_explicit(&(a->slots[bottom & (a->size - 1)]), data, memory_order_relaxed);
+    atomic_store_explicit(&(d->bottom), bottom + 1, memory_order_release);
+}
+
+void *atm_deque_pop(atm_deque *d)
+{
+    // reserve the bottom slot first, the fence orders this against thieves reading bottom
+    long bottom = atomic_load_explicit(&(d->bottom), memory_order_relaxed) - 1;
+    struct deque_array *a = atomic_load_explicit(&(d->array), memory_order_relaxed);
+    atomic_store_explicit(&(d->bottom), bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&(d->top), memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        // deque was empty, put bottom back
+        atomic_store_explicit(&(d->bottom), bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    void *res = atomic_load_explicit(&(a->slots[bottom & (a->size - 1)]), memory_order_relaxed);
+    if (top == bottom)
+    {
+        // last item, race thieves for it through top
+        if (!atomic_compare_exchange_strong_explicit(&(d->top), &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+            res = NULL;
+        atomic_store_explicit(&(d->bottom), bottom + 1, memory_order_relaxed);
+    }
+    return res;
+}
+
+void *atm_deque_steal(atm_deque *d)
+{
+    long top = atomic_load_explicit(&(d->top), memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&(d->bottom), memory_order_acquire);
+    if (top >= bottom)
+        return NULL;
+
+    // the array stays protected while we read from it, the owner may swap it for a bigger one meanwhile
+    unsigned int guard = atm_reclaim_enter(1);
+    struct deque_array *a = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(d->array));
+    void *res = atomic_load_explicit(&(a->slots[top & (a->size - 1)]), memory_order_relaxed);
+    atm_reclaim_exit(guard, 1);
+
+    // losing the race to the owner or another thief reads as empty, callers just move on
+    if (!atomic_compare_exchange_strong_explicit(&(d->top), &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+    return res;
+}
+
+size_t atm_deque_size(atm_deque *d)
+{
+    // only a snapshot, either end may move straight after
+    long bottom = atomic_load_explicit(&(d->bottom), memory_order_relaxed);
+    long top = atomic_load_explicit(&(d->top), memory_order_relaxed);
+    return bottom > top ? (size_t)(bottom - top) : 0;
+}
+
+void free_atm_deque(atm_deque *d)
+{
+    free_atm_deque_auto(d);
+    free(d);
+}
+
+void free_atm_deque_auto(atm_deque *d)
+{
+    // free any data still held by the deque
+    void *data;
+    while ((data = atm_deque_pop(d)))
+        free(data);
+
+    while (d->retired)
+    {
+        struct deque_array *prev = d->retired->prev;
+        free(d->retired);
+        d->retired = prev;
+    }
+    free(atomic_load_explicit(&(d->array), memory_order_relaxed));
+    atomic_store_explicit(&(d->array), NULL, memory_order_relaxed);
+}
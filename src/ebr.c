@@ -0,0 +1,141 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "ebr.h"
+
+// the global epoch lives on its own line, every enter reads it but only advancing writes it
+static struct {
+    _Alignas(ATM_CACHE_LINE) _Atomic unsigned long epoch;
+} ebr_global;
+
+// registry of every thread slot ever handed out, slots are recycled but never freed
+static struct ebr_thread *_Atomic ebr_threads = NULL;
+
+static _Thread_local struct ebr_thread *ebr_self = NULL;
+static pthread_key_t ebr_key;
+static pthread_once_t ebr_key_once = PTHREAD_ONCE_INIT;
+
+static void ebr_thread_release(void *arg)
+{
+    // thread is exiting, mark the slot quiescent and let another thread take it over
+    struct ebr_thread *t = (struct ebr_thread*)arg;
+    atomic_store_explicit(&(t->epoch), 0, memory_order_release);
+    t->nesting = 0;
+    t->retired = 0;
+    atomic_store_explicit(&(t->in_use), false, memory_order_release);
+}
+
+static void ebr_key_create(void)
+{
+    pthread_key_create(&ebr_key, ebr_thread_release);
+}
+
+static struct ebr_thread *ebr_register(void)
+{
+    pthread_once(&ebr_key_once, ebr_key_create);
+
+    // reuse a slot left behind by an exited thread before growing the registry
+    struct ebr_thread *t = atomic_load_explicit(&ebr_threads, memory_order_acquire);
+    for (; t; t = t->next)
+    {
+        bool in_use = false;
+        if (
+            !atomic_load_explicit(&(t->in_use), memory_order_relaxed) &&
+            atomic_compare_exchange_strong_explicit(&(t->in_use), &in_use, true, memory_order_acquire, memory_order_relaxed)
+        )
+            break;
+    }
+
+    if (!t)
+    {
+        t = aligned_alloc(ATM_CACHE_LINE, sizeof(struct ebr_thread));
+        atomic_store_explicit(&(t->epoch), 0, memory_order_relaxed);
+        atomic_store_explicit(&(t->in_use), true, memory_order_relaxed);
+        t->nesting = 0;
+        t->retired = 0;
+
+        struct ebr_thread *head = atomic_load_explicit(&ebr_threads, memory_order_relaxed);
+        t->next = head;
+        while (!atomic_compare_exchange_weak_explicit(&ebr_threads, &head, t, memory_order_release, memory_order_relaxed))
+            t->next = head;
+    }
+
+    pthread_setspecific(ebr_key, t);
+    ebr_self = t;
+    return t;
+}
+
+void atm_ebr_enter(void)
+{
+    struct ebr_thread *self = ebr_self ? ebr_self : ebr_register();
+    if (self->nesting++ > 0)
+        return;
+
+    // announce the epoch we observed, the low bit marks the slot as active
+    unsigned long epoch = atomic_load_explicit(&(ebr_global.epoch), memory_order_relaxed);
+    atomic_store_explicit(&(self->epoch), (epoch << 1) | 1, memory_order_relaxed);
+
+    // pairs with the fence in atm_ebr_try_advance, either the advancing thread sees this slot
+    // as active or every load we make after this sees the memory it was protecting
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void atm_ebr_exit(void)
+{
+    struct ebr_thread *self = ebr_self;
+    if (--self->nesting > 0)
+        return;
+
+    // release so everything read in the critical section happens before a later reclaim
+    atomic_store_explicit(&(self->epoch), 0, memory_order_release);
+}
+
+unsigned long atm_ebr_epoch(void)
+{
+    return atomic_load_explicit(&(ebr_global.epoch), memory_order_acquire);
+}
+
+unsigned long atm_ebr_retire_epoch(void)
+{
+    // called after a node has been unlinked, the fence orders the unlink before reading the epoch
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load_explicit(&(ebr_global.epoch), memory_order_relaxed);
+}
+
+bool atm_ebr_is_safe(unsigned long retire_epoch)
+{
+    // once the epoch has moved on twice no thread can still be reading a node retired in retire_epoch
+    return atomic_load_explicit(&(ebr_global.epoch), memory_order_acquire) >= retire_epoch + 2;
+}
+
+bool atm_ebr_try_advance(void)
+{
+    unsigned long epoch = atomic_load_explicit(&(ebr_global.epoch), memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    // the epoch may only move on once every active thread has observed the current one
+    for (struct ebr_thread *t = atomic_load_explicit(&ebr_threads, memory_order_acquire); t; t = t->next)
+    {
+        unsigned long local = atomic_load_explicit(&(t->epoch), memory_order_relaxed);
+        if ((local & 1) && (local >> 1) != epoch)
+            return false;
+    }
+
+    // synchronize with every critical section that has since exited
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_compare_exchange_strong_explicit(&(ebr_global.epoch), &epoch, epoch + 1, memory_order_release, memory_order_relaxed);
+}
+
+bool atm_ebr_tick(unsigned int nretired)
+{
+    // counts this threads retirements, returns true once enough have built up to be worth reclaiming
+    struct ebr_thread *self = ebr_self ? ebr_self : ebr_register();
+    self->retired += nretired;
+    if (self->retired < ATM_EBR_RECLAIM_INTERVAL)
+        return false;
+
+    self->retired = 0;
+    return true;
+}
@@ -0,0 +1,282 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <limits.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "executor.h"
+
+#define EXECUTOR_GROUP_WAITING 0x80000000u
+#define EXECUTOR_GROUP_COUNT (~EXECUTOR_GROUP_WAITING)
+
+struct executor_task {
+    void (*fn)(void *);
+    void *arg;
+    struct atm_task_group *group;
+};
+
+// set on every worker thread, lets submit and wait tell a worker of this executor from anyone else
+static _Thread_local struct executor_worker *executor_self = NULL;
+
+// every thread gets its own random stream for picking victims
+static _Atomic unsigned long executor_next_thread = 0;
+static _Thread_local uint64_t executor_rng = 0;
+
+static uint64_t executor_random(void)
+{
+    if (!executor_rng)
+        executor_rng = (atomic_fetch_add_explicit(&executor_next_thread, 1, memory_order_relaxed) + 1) * 0x9E3779B97F4A7C15ULL;
+
+    // xorshift64, plenty for picking victims
+    executor_rng ^= executor_rng << 13;
+    executor_rng ^= executor_rng >> 7;
+    executor_rng ^= executor_rng << 17;
+    return executor_rng;
+}
+
+static void executor_futex_wait(_Atomic unsigned int *addr, unsigned int val)
+{
+#ifdef __linux__
+    // returns straight away if addr no longer holds val, so a wake between our check and this call isn't lost
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+    sched_yield();
+#endif
+}
+
+static void executor_futex_wake(_Atomic unsigned int *addr)
+{
+#ifdef __linux__
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+static struct executor_worker *executor_current(atm_executor *ex)
+{
+    return executor_self && executor_self->ex == ex ? executor_self : NULL;
+}
+
+static struct executor_task *executor_find(atm_executor *ex, struct executor_worker *self)
+{
+    // own work first while it is cache warm, then outside submissions, then other workers' oldest tasks
+    struct executor_task *task;
+    if (self && (task = atm_deque_pop(&(self->deque))))
+        return task;
+    if ((task = atm_queue_dequeue(&(ex->injection))))
+        return task;
+
+    size_t start = executor_random() % ex->nworkers;
+    for (size_t i = 0; i < ex->nworkers; i++)
+    {
+        struct executor_worker *victim = &(ex->workers[(start + i) % ex->nworkers]);
+        if (victim != self && (task = atm_deque_steal(&(victim->deque))))
+            return task;
+    }
+    return NULL;
+}
+
+static void executor_run(struct executor_task *task)
+{
+    struct atm_task_group *group = task->group;
+    task->fn(task->arg);
+    free(task);
+
+    // release so a waiter seeing the count drop also sees everything the task did. The decrement is the
+    // last access to the group, the wake only passes its address so the waiter may already have freed it
+    if (group && atomic_fetch_sub_explicit(&(group->pending), 1, memory_order_release) == (EXECUTOR_GROUP_WAITING | 1))
+        executor_futex_wake(&(group->pending));
+}
+
+static void executor_notify(atm_executor *ex)
+{
+    // the task is published before we look for sleepers, pairs with the fence a worker issues before its last look
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&(ex->sleepers), memory_order_acquire) == 0)
+        return;
+
+    pthread_mutex_lock(&(ex->lock));
+    atomic_fetch_add_explicit(&(ex->wake_seq), 1, memory_order_relaxed);
+    pthread_cond_signal(&(ex->wake));
+    pthread_mutex_unlock(&(ex->lock));
+}
+
+static void *executor_worker_body(void *arg)
+{
+    struct executor_worker *self = (struct executor_worker *)arg;
+    atm_executor *ex = self->ex;
+    executor_self = self;
+
+    while (1)
+    {
+        struct executor_task *task = NULL;
+        for (int i = 0; i < ATM_EXECUTOR_IDLE_SPINS && !task; i++)
+            if (!(task = executor_find(ex, self)))
+                sched_yield();
+
+        if (!task)
+        {
+            // announce we are about to park and look once more, a submit racing with us either sees a
+            // sleeper and bumps wake_seq or published its task before our last look
+            unsigned int seq = atomic_load_explicit(&(ex->wake_seq), memory_order_relaxed);
+            atomic_fetch_add_explicit(&(ex->sleepers), 1, memory_order_acq_rel);
+            atomic_thread_fence(memory_order_seq_cst);
+
+            task = executor_find(ex, self);
+            if (!task)
+            {
+                pthread_mutex_lock(&(ex->lock));
+                while (atomic_load_explicit(&(ex->wake_seq), memory_order_relaxed) == seq &&
+                       !atomic_load_explicit(&(ex->stopping), memory_order_relaxed))
+                    pthread_cond_wait(&(ex->wake), &(ex->lock));
+                pthread_mutex_unlock(&(ex->lock));
+            }
+            atomic_fetch_sub_explicit(&(ex->sleepers), 1, memory_order_relaxed);
+        }
+
+        // once stopping, leave only after a final look turns up nothing
+        if (!task && atomic_load_explicit(&(ex->stopping), memory_order_acquire) && !(task = executor_find(ex, self)))
+            break;
+        if (task)
+            executor_run(task);
+    }
+
+    return NULL;
+}
+
+static void executor_shutdown(atm_executor *ex, size_t nstarted)
+{
+    // workers drain every deque and the injection queue before they exit
+    pthread_mutex_lock(&(ex->lock));
+    atomic_store_explicit(&(ex->stopping), true, memory_order_release);
+    pthread_cond_broadcast(&(ex->wake));
+    pthread_mutex_unlock(&(ex->lock));
+
+    for (size_t i = 0; i < nstarted; i++)
+        pthread_join(ex->workers[i].thread, NULL);
+
+    for (size_t i = 0; i < ex->nworkers; i++)
+        free_atm_deque_auto(&(ex->workers[i].deque));
+    free(ex->workers);
+    ex->workers = NULL;
+    free_atm_queue_auto(&(ex->injection));
+
+    pthread_cond_destroy(&(ex->wake));
+    pthread_mutex_destroy(&(ex->lock));
+}
+
+bool atm_executor_init(atm_executor *ex, size_t nworkers)
+{
+    if (nworkers == 0)
+        nworkers = 1;
+
+    // workers are padded to whole cache lines, so they need an aligned allocation
+    ex->workers = aligned_alloc(ATM_CACHE_LINE, nworkers * sizeof(struct executor_worker));
+    ex->nworkers = nworkers;
+    atm_queue_init(&(ex->injection));
+    atomic_store_explicit(&(ex->sleepers), 0, memory_order_relaxed);
+    atomic_store_explicit(&(ex->wake_seq), 0, memory_order_relaxed);
+    atomic_store_explicit(&(ex->stopping), false, memory_order_relaxed);
+    pthread_mutex_init(&(ex->lock), NULL);
+    pthread_cond_init(&(ex->wake), NULL);
+
+    // every deque exists before any worker starts stealing from it
+    for (size_t i = 0; i < nworkers; i++)
+    {
+        atm_deque_init(&(ex->workers[i].deque), 64);
+        ex->workers[i].ex = ex;
+    }
+
+    for (size_t i = 0; i < nworkers; i++)
+    {
+        if (pthread_create(&(ex->workers[i].thread), NULL, executor_worker_body, &(ex->workers[i])))
+        {
+            // stop whatever did start and leave the executor uninitialised
+            executor_shutdown(ex, i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void atm_task_group_init(struct atm_task_group *group)
+{
+    atomic_store_explicit(&(group->pending), 0, memory_order_relaxed);
+}
+
+void atm_executor_submit(atm_executor *ex, struct atm_task_group *group, void (*fn)(void *), void *arg)
+{
+    struct executor_task *task = malloc(sizeof(struct executor_task));
+    task->fn = fn;
+    task->arg = arg;
+    task->group = group;
+    if (group)
+        atomic_fetch_add_explicit(&(group->pending), 1, memory_order_relaxed);
+
+    // a worker keeps what it spawns local, everyone else goes through the injection queue
+    struct executor_worker *self = executor_current(ex);
+    if (self)
+        atm_deque_push(&(self->deque), task);
+    else
+        atm_queue_enqueue(&(ex->injection), task);
+
+    executor_notify(ex);
+}
+
+void atm_executor_wait(atm_executor *ex, struct atm_task_group *group)
+{
+    // a worker helps out rather than block, waiting inside a task would otherwise hold up its own deque
+    struct executor_worker *self = executor_current(ex);
+    if (self)
+    {
+        while (atomic_load_explicit(&(group->pending), memory_order_acquire) & EXECUTOR_GROUP_COUNT)
+        {
+            struct executor_task *task = executor_find(ex, self);
+            if (task)
+                executor_run(task);
+            else
+                sched_yield();
+        }
+        return;
+    }
+
+    // anyone else gives short groups a moment, then parks instead of taking a core from the workers
+    for (int i = 0; i < ATM_EXECUTOR_WAIT_SPINS; i++)
+    {
+        if (!(atomic_load_explicit(&(group->pending), memory_order_acquire) & EXECUTOR_GROUP_COUNT))
+            return;
+        sched_yield();
+    }
+
+    // setting the flag and the last task's decrement are ordered on the same word, the task either sees
+    // the flag and wakes us or our compare and swap fails and we see the count at zero
+    unsigned int pending = atomic_load_explicit(&(group->pending), memory_order_acquire);
+    while (pending & EXECUTOR_GROUP_COUNT)
+    {
+        if (!(pending & EXECUTOR_GROUP_WAITING) &&
+            !atomic_compare_exchange_weak_explicit(&(group->pending), &pending, pending | EXECUTOR_GROUP_WAITING, memory_order_acquire, memory_order_acquire))
+            continue;
+
+        executor_futex_wait(&(group->pending), pending | EXECUTOR_GROUP_WAITING);
+        pending = atomic_load_explicit(&(group->pending), memory_order_acquire);
+    }
+}
+
+void free_atm_executor(atm_executor *ex)
+{
+    free_atm_executor_auto(ex);
+    free(ex);
+}
+
+void free_atm_executor_auto(atm_executor *ex)
+{
+    executor_shutdown(ex, ex->nworkers);
+}
@@ -0,0 +1,216 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "faa_queue.h"
+#include "reclaim.h"
+
+// written into a slot by a dequeuer that got there before its producer, the producer then moves on to another slot
+static char faa_taken;
+
+static struct faa_segment *faa_segment_new(void *first)
+{
+    // segments are padded to whole cache lines, so they need an aligned allocation
+    struct faa_segment *seg = aligned_alloc(ATM_CACHE_LINE, sizeof(struct faa_segment));
+    atomic_store_explicit(&(seg->deq_idx), 0, memory_order_relaxed);
+    atomic_store_explicit(&(seg->next), NULL, memory_order_relaxed);
+    seg->retired_next = NULL;
+    seg->retire_epoch = 0;
+
+    // a segment created to hold an item starts out with it in slot 0
+    atomic_store_explicit(&(seg->enq_idx), first ? 1 : 0, memory_order_relaxed);
+    atomic_store_explicit(&(seg->items[0]), first, memory_order_relaxed);
+    for (size_t i = 1; i < ATM_FAA_SEGMENT_SIZE; i++)
+        atomic_store_explicit(&(seg->items[i]), NULL, memory_order_relaxed);
+
+    return seg;
+}
+
+static void atm_faa_queue_reclaim_deferred(void *arg)
+{
+    atm_faa_queue_reclaim((atm_faa_queue *)arg);
+}
+
+void atm_faa_queue_init(atm_faa_queue *q)
+{
+    struct faa_segment *seg = faa_segment_new(NULL);
+    q->head = seg;
+    q->tail = seg;
+    q->retired = NULL;
+    atm_deferred_init(&(q->deferred), atm_faa_queue_reclaim_deferred, q);
+}
+
+void atm_faa_queue_enqueue(atm_faa_queue *q, void *data)
+{
+    unsigned int guard = atm_reclaim_enter(1);
+
+    while (1)
+    {
+        struct faa_segment *cur_tail = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(q->tail));
+        size_t idx = atomic_fetch_add_explicit(&(cur_tail->enq_idx), 1, memory_order_relaxed);
+
+        if (idx < ATM_FAA_SEGMENT_SIZE)
+        {
+            // the slot is ours unless a dequeuer already gave up waiting on it
+            void *expected = NULL;
+            if (atomic_compare_exchange_strong_explicit(&(cur_tail->items[idx]), &expected, data, memory_order_release, memory_order_relaxed))
+                break;
+            continue;
+        }
+
+        // the segment is full, append a new one holding our item or help the tail onto the one already there
+        if (atomic_load_explicit(&(q->tail), memory_order_acquire) != cur_tail)
+            continue;
+
+        struct faa_segment *next = atomic_load_explicit(&(cur_tail->next), memory_order_acquire);
+        if (next == NULL)
+        {
+            struct faa_segment *seg = faa_segment_new(data);
+            if (atomic_compare_exchange_strong_explicit(&(cur_tail->next), &next, seg, memory_order_release, memory_order_acquire))
+            {
+                atomic_compare_exchange_strong_explicit(&(q->tail), &cur_tail, seg, memory_order_release, memory_order_relaxed);
+                break;
+            }
+            free(seg);
+        }
+        else
+            atomic_compare_exchange_strong_explicit(&(q->tail), &cur_tail, next, memory_order_release, memory_order_relaxed);
+    }
+
+    atm_reclaim_exit(guard, 1);
+}
+
+static void atm_faa_queue_retire(atm_faa_queue *q, struct faa_segment *seg)
+{
+    seg->retire_epoch = atm_reclaim_tag();
+
+    struct faa_segment *cur = atomic_load_explicit(&(q->retired), memory_order_relaxed);
+    seg->retired_next = cur;
+    while (!atomic_compare_exchange_weak_explicit(&(q->retired), &cur, seg, memory_order_release, memory_order_relaxed))
+        seg->retired_next = cur;
+}
+
+void *atm_faa_queue_dequeue(atm_faa_queue *q)
+{
+    unsigned int guard = atm_reclaim_enter(1);
+    void *res = NULL;
+    bool retired = false;
+
+    while (1)
+    {
+        struct faa_segment *cur_head = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(q->head));
+
+        // check for an empty queue before claiming, otherwise every empty poll would burn a slot
+        if (atomic_load_explicit(&(cur_head->deq_idx), memory_order_relaxed) >= atomic_load_explicit(&(cur_head->enq_idx), memory_order_relaxed) &&
+            atomic_load_explicit(&(cur_head->next), memory_order_acquire) == NULL)
+            break;
+
+        size_t idx = atomic_fetch_add_explicit(&(cur_head->deq_idx), 1, memory_order_relaxed);
+        if (idx >= ATM_FAA_SEGMENT_SIZE)
+        {
+            // this segment is drained, move the head on and retire it
+            struct faa_segment *next = atomic_load_explicit(&(cur_head->next), memory_order_acquire);
+            if (next == NULL)
+                break;
+
+            // never retire a segment the tail still points at, help the tail past it first
+            struct faa_segment *cur_tail = atomic_load_explicit(&(q->tail), memory_order_acquire);
+            if (cur_tail == cur_head)
+                atomic_compare_exchange_strong_explicit(&(q->tail), &cur_tail, next, memory_order_release, memory_order_relaxed);
+
+            if (atomic_compare_exchange_strong_explicit(&(q->head), &cur_head, next, memory_order_release, memory_order_relaxed))
+            {
+                atm_faa_queue_retire(q, cur_head);
+                retired = true;
+            }
+            continue;
+        }
+
+        // a producer that claimed this slot but hasn't written it yet will find it taken and try again elsewhere
+        void *item = atomic_exchange_explicit(&(cur_head->items[idx]), &faa_taken, memory_order_acquire);
+        if (item != NULL)
+        {
+            res = item;
+            break;
+        }
+    }
+
+    atm_reclaim_exit(guard, 1);
+
+    if (retired && atm_reclaim_tick(1) && !atm_reclaimer_defer(&(q->deferred)))
+        atm_faa_queue_reclaim(q);
+
+    return res;
+}
+
+void atm_faa_queue_reclaim(atm_faa_queue *q)
+{
+    // take the whole retired stack, segments that aren't safe yet get pushed back
+    struct faa_segment *seg = atomic_exchange_explicit(&(q->retired), NULL, memory_order_acquire);
+    struct reclaim_scan scan;
+    atm_reclaim_scan_begin(&scan);
+
+    struct faa_segment *keep_first = NULL;
+    struct faa_segment *keep_last = NULL;
+
+    while (seg)
+    {
+        struct faa_segment *temp = seg->retired_next;
+        if (atm_reclaim_is_safe(&scan, seg, seg->retire_epoch))
+            free(seg);
+        else
+        {
+            seg->retired_next = keep_first;
+            if (!keep_last)
+                keep_last = seg;
+            keep_first = seg;
+        }
+        seg = temp;
+    }
+
+    atm_reclaim_scan_end(&scan);
+
+    if (keep_first)
+    {
+        struct faa_segment *cur = atomic_load_explicit(&(q->retired), memory_order_relaxed);
+        keep_last->retired_next = cur;
+        while (!atomic_compare_exchange_weak_explicit(&(q->retired), &cur, keep_first, memory_order_release, memory_order_relaxed))
+            keep_last->retired_next = cur;
+    }
+}
+
+void free_atm_faa_queue(atm_faa_queue *q)
+{
+    free_atm_faa_queue_auto(q);
+    free(q);
+}
+
+void free_atm_faa_queue_auto(atm_faa_queue *q)
+{
+    atm_reclaimer_cancel(&(q->deferred));
+
+    struct faa_segment *seg = atomic_exchange_explicit(&(q->retired), NULL, memory_order_relaxed);
+    while (seg)
+    {
+        struct faa_segment *temp = seg->retired_next;
+        free(seg);
+        seg = temp;
+    }
+
+    // like atm_queue, items still in the queue are owned by it
+    seg = atomic_load_explicit(&(q->head), memory_order_relaxed);
+    while (seg)
+    {
+        for (size_t i = 0; i < ATM_FAA_SEGMENT_SIZE; i++)
+        {
+            void *item = atomic_load_explicit(&(seg->items[i]), memory_order_relaxed);
+            if (item && item != &faa_taken)
+                free(item);
+        }
+
+        struct faa_segment *temp = atomic_load_explicit(&(seg->next), memory_order_relaxed);
+        free(seg);
+        seg = temp;
+    }
+}
@@ -0,0 +1,183 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "hp.h"
+
+// registry of every thread's hazard slots, slots are recycled but never freed
+static struct hp_thread *_Atomic hp_threads = NULL;
+
+static _Thread_local struct hp_thread *hp_self = NULL;
+static pthread_key_t hp_key;
+static pthread_once_t hp_key_once = PTHREAD_ONCE_INIT;
+
+// reclaiming threads reuse their snapshot buffer between scans
+static _Thread_local void **hp_scan_buf = NULL;
+static _Thread_local size_t hp_scan_cap = 0;
+
+static void hp_thread_release(void *arg)
+{
+    // thread is exiting, drop any hazards it still holds and let another thread take the slots over
+    struct hp_thread *t = (struct hp_thread*)arg;
+    for (unsigned int i = 0; i < ATM_HP_SLOTS; i++)
+        atomic_store_explicit(&(t->hazards[i]), NULL, memory_order_release);
+    t->depth = 0;
+    t->retired = 0;
+    atomic_store_explicit(&(t->in_use), false, memory_order_release);
+
+    free(hp_scan_buf);
+    hp_scan_buf = NULL;
+    hp_scan_cap = 0;
+}
+
+static void hp_key_create(void)
+{
+    pthread_key_create(&hp_key, hp_thread_release);
+}
+
+static struct hp_thread *hp_register(void)
+{
+    pthread_once(&hp_key_once, hp_key_create);
+
+    // reuse slots left behind by an exited thread before growing the registry
+    struct hp_thread *t = atomic_load_explicit(&hp_threads, memory_order_acquire);
+    for (; t; t = t->next)
+    {
+        bool in_use = false;
+        if (
+            !atomic_load_explicit(&(t->in_use), memory_order_relaxed) &&
+            atomic_compare_exchange_strong_explicit(&(t->in_use), &in_use, true, memory_order_acquire, memory_order_relaxed)
+        )
+            break;
+    }
+
+    if (!t)
+    {
+        t = aligned_alloc(ATM_CACHE_LINE, sizeof(struct hp_thread));
+        for (unsigned int i = 0; i < ATM_HP_SLOTS; i++)
+            atomic_store_explicit(&(t->hazards[i]), NULL, memory_order_relaxed);
+        atomic_store_explicit(&(t->in_use), true, memory_order_relaxed);
+        t->depth = 0;
+        t->retired = 0;
+
+        struct hp_thread *head = atomic_load_explicit(&hp_threads, memory_order_relaxed);
+        t->next = head;
+        while (!atomic_compare_exchange_weak_explicit(&hp_threads, &head, t, memory_order_release, memory_order_relaxed))
+            t->next = head;
+    }
+
+    pthread_setspecific(hp_key, t);
+    hp_self = t;
+    return t;
+}
+
+unsigned int atm_hp_enter(unsigned int nslots)
+{
+    // reserve nslots on top of whatever an enclosing operation is already holding
+    struct hp_thread *self = hp_self ? hp_self : hp_register();
+    unsigned int base = self->depth;
+    if (base + nslots > ATM_HP_SLOTS)
+    {
+        fprintf(stderr, "hazard pointer slots exhausted, raise ATM_HP_SLOTS\n");
+        abort();
+    }
+
+    self->depth += nslots;
+    return base;
+}
+
+void atm_hp_exit(unsigned int base, unsigned int nslots)
+{
+    struct hp_thread *self = hp_self;
+    for (unsigned int i = base; i < base + nslots; i++)
+        atomic_store_explicit(&(self->hazards[i]), NULL, memory_order_release);
+    self->depth = base;
+}
+
+void atm_hp_pop(unsigned int nslots)
+{
+    // release the most recently reserved slots, for callers that don't keep their guard around
+    atm_hp_exit(hp_self->depth - nslots, nslots);
+}
+
+void *atm_hp_protect(unsigned int slot, void *_Atomic *src)
+{
+    struct hp_thread *self = hp_self;
+    void *ptr = atomic_load_explicit(src, memory_order_relaxed);
+
+    while (1)
+    {
+        atomic_store_explicit(&(self->hazards[slot]), ptr, memory_order_relaxed);
+        // pairs with the fence in atm_hp_snapshot, either the scan sees our hazard or we see the unlink
+        atomic_thread_fence(memory_order_seq_cst);
+
+        void *again = atomic_load_explicit(src, memory_order_acquire);
+        if (again == ptr)
+            return ptr;
+        ptr = again;
+    }
+}
+
+void atm_hp_hold(unsigned int slot, void *ptr)
+{
+    // publish a hazard on a pointer we already have, the caller must re-validate its source afterwards
+    atomic_store_explicit(&(hp_self->hazards[slot]), ptr, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+bool atm_hp_tick(unsigned int nretired)
+{
+    // counts this threads retirements, returns true once enough have built up to be worth a scan
+    struct hp_thread *self = hp_self ? hp_self : hp_register();
+    self->retired += nretired;
+    if (self->retired < ATM_HP_RECLAIM_INTERVAL)
+        return false;
+
+    self->retired = 0;
+    return true;
+}
+
+static int hp_ptr_cmp(const void *a, const void *b)
+{
+    void *x = *(void *const *)a;
+    void *y = *(void *const *)b;
+    return (x > y) - (x < y);
+}
+
+void atm_hp_snapshot(struct hp_snapshot *snap)
+{
+    // a thread that only ever reclaims still needs registering, the exit destructor is what frees its buffer
+    if (!hp_self)
+        hp_register();
+
+    // order the unlinks that made nodes retired before reading any hazards
+    atomic_thread_fence(memory_order_seq_cst);
+
+    size_t n = 0;
+    for (struct hp_thread *t = atomic_load_explicit(&hp_threads, memory_order_acquire); t; t = t->next)
+    {
+        if (hp_scan_cap < n + ATM_HP_SLOTS)
+        {
+            hp_scan_cap = hp_scan_cap ? hp_scan_cap * 2 : 8 * ATM_HP_SLOTS;
+            hp_scan_buf = realloc(hp_scan_buf, hp_scan_cap * sizeof(void*));
+        }
+
+        for (unsigned int i = 0; i < ATM_HP_SLOTS; i++)
+        {
+            void *ptr = atomic_load_explicit(&(t->hazards[i]), memory_order_acquire);
+            if (ptr)
+                hp_scan_buf[n++] = ptr;
+        }
+    }
+
+    qsort(hp_scan_buf, n, sizeof(void*), hp_ptr_cmp);
+    snap->hazards = hp_scan_buf;
+    snap->n = n;
+}
+
+bool atm_hp_snapshot_contains(struct hp_snapshot *snap, void *ptr)
+{
+    return bsearch(&ptr, snap->hazards, snap->n, sizeof(void*), hp_ptr_cmp) != NULL;
+}
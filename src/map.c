@@ -0,0 +1,564 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include "map.h"
+#include "reclaim.h"
+
+// head of an old bucket once its nodes have moved to the newer table
+#define MAP_MOVED ((struct map_node *)1)
+// returned by a bucket walk that ran into an unlinked node
+#define MAP_RETRY ((struct map_node *)2)
+
+// reader slots, the current and old table then two for walking hand over hand
+#define MAP_READ_SLOTS 4
+// writer slots, the current and old table, nodes in a locked bucket can't be retired under us
+#define MAP_WRITE_SLOTS 2
+
+// hands each thread the next count stripe the first time it inserts or removes
+static _Atomic unsigned int map_next_stripe = 0;
+static _Thread_local unsigned int map_stripe = 0;
+static _Thread_local bool map_has_stripe = false;
+
+static inline bool map_is_marked(struct map_node *node)
+{
+    return ((uintptr_t)node & 1) != 0;
+}
+
+static inline struct map_node *map_mark(struct map_node *node)
+{
+    return (struct map_node *)((uintptr_t)node | 1);
+}
+
+static inline uint64_t map_hash(uint64_t key)
+{
+    // splitmix64 finaliser, spreads sequential keys over every bucket
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    key ^= key >> 31;
+    return key;
+}
+
+static struct map_node *map_node_new(uint64_t key, void *value)
+{
+    struct map_node *node = malloc(sizeof(struct map_node));
+    node->key = key;
+    node->value = value;
+    atomic_store_explicit(&(node->next), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(node->free_next), NULL, memory_order_relaxed);
+    node->retire_epoch = 0;
+    node->value_refs = NULL;
+    return node;
+}
+
+static void free_map_node(struct map_node *node)
+{
+    // a value shared with copies made by a resize goes with the last node referencing it
+    if (node->value_refs)
+    {
+        if (atomic_fetch_sub_explicit(node->value_refs, 1, memory_order_acq_rel) == 1)
+        {
+            free(node->value);
+            free(node->value_refs);
+        }
+    }
+    else if (node->value)
+        free(node->value);
+    free(node);
+}
+
+static struct map_table *map_table_new(size_t nbuckets)
+{
+    struct map_table *t = malloc(sizeof(struct map_table) + nbuckets * sizeof(struct map_bucket));
+    t->mask = nbuckets - 1;
+    atomic_store_explicit(&(t->prev), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(t->migrate_next), 0, memory_order_relaxed);
+    atomic_store_explicit(&(t->migrate_done), 0, memory_order_relaxed);
+    atomic_store_explicit(&(t->free_next), NULL, memory_order_relaxed);
+    t->retire_epoch = 0;
+    for (size_t i = 0; i < nbuckets; i++)
+    {
+        atomic_store_explicit(&(t->buckets[i].head), NULL, memory_order_relaxed);
+        atomic_store_explicit(&(t->buckets[i].lock), false, memory_order_relaxed);
+    }
+    return t;
+}
+
+static void free_map_table(struct map_table *t)
+{
+    // moved buckets have already handed their nodes to retirement
+    for (size_t i = 0; i <= t->mask; i++)
+    {
+        struct map_node *node = atomic_load_explicit(&(t->buckets[i].head), memory_order_relaxed);
+        if (node == MAP_MOVED)
+            continue;
+        while (node)
+        {
+            struct map_node *next = atomic_load_explicit(&(node->next), memory_order_relaxed);
+            free_map_node(node);
+            node = next;
+        }
+    }
+    free(t);
+}
+
+static long map_count_add(atm_map *map, long n)
+{
+    if (!map_has_stripe)
+    {
+        map_stripe = atomic_fetch_add_explicit(&map_next_stripe, 1, memory_order_relaxed) % ATM_MAP_COUNT_STRIPES;
+        map_has_stripe = true;
+    }
+
+    // returns this stripe's new value, it is almost always written by this thread alone
+    return atomic_fetch_add_explicit(&(map->counts[map_stripe].count), n, memory_order_relaxed) + n;
+}
+
+static long map_count(atm_map *map)
+{
+    long count = 0;
+    for (int i = 0; i < ATM_MAP_COUNT_STRIPES; i++)
+        count += atomic_load_explicit(&(map->counts[i].count), memory_order_relaxed);
+    return count;
+}
+
+static void atm_map_reclaim_deferred(void *arg)
+{
+    atm_map_reclaim((atm_map *)arg);
+}
+
+void atm_map_init(atm_map *map, void *(*cpy)(void*))
+{
+    atomic_store_explicit(&(map->table), map_table_new(ATM_MAP_INITIAL_BUCKETS), memory_order_relaxed);
+    map->cpy = cpy;
+    for (int i = 0; i < ATM_MAP_COUNT_STRIPES; i++)
+        atomic_store_explicit(&(map->counts[i].count), 0, memory_order_relaxed);
+    atomic_store_explicit(&(map->retired), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(map->retired_tables), NULL, memory_order_relaxed);
+    atm_deferred_init(&(map->deferred), atm_map_reclaim_deferred, map);
+#ifdef ATM_STATS
+    atm_stats_init(map->stats);
+#endif
+}
+
+// looks the key up in one bucket, the node found stays protected until the section is exited
+static struct map_node *map_bucket_find(unsigned int guard, struct map_bucket *b, uint64_t key)
+{
+    unsigned int slot = 2;
+    struct map_node *node = atm_reclaim_protect(guard, slot, (void *_Atomic *)&(b->head));
+    if (node == MAP_MOVED)
+        return MAP_MOVED;
+
+    while (node)
+    {
+        if (node->key == key)
+            return node;
+
+        // a marked link means this node was unlinked after we reached it, its successor may be gone too
+        slot ^= 1;
+        struct map_node *next = atm_reclaim_protect(guard, slot, (void *_Atomic *)&(node->next));
+        if (map_is_marked(next))
+            return MAP_RETRY;
+        node = next;
+    }
+    return NULL;
+}
+
+static struct map_node *map_lookup(unsigned int guard, atm_map *map, uint64_t key)
+{
+    uint64_t hash = map_hash(key);
+    while (1)
+    {
+        // the old table is only unlinked from the current one once none of its buckets are in use
+        struct map_table *t = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(map->table));
+        struct map_table *o = atm_reclaim_protect(guard, 1, (void *_Atomic *)&(t->prev));
+        struct map_node *node;
+
+        // an old bucket that hasn't moved yet is still the one writers update
+        if (o)
+        {
+            node = map_bucket_find(guard, &(o->buckets[hash & o->mask]), key);
+            if (node == MAP_RETRY)
+                continue;
+            if (node != MAP_MOVED)
+                return node;
+        }
+
+        // a moved bucket in the current table means a newer resize has started, look again from the top
+        node = map_bucket_find(guard, &(t->buckets[hash & t->mask]), key);
+        if (node != MAP_RETRY && node != MAP_MOVED)
+            return node;
+    }
+}
+
+void *atm_map_get(atm_map *map, uint64_t key)
+{
+    // copy the value while its node is protected, the copy belongs to the caller
+    unsigned int guard = atm_reclaim_enter(MAP_READ_SLOTS);
+    struct map_node *node = map_lookup(guard, map, key);
+    void *res = node ? map->cpy(node->value) : NULL;
+    atm_reclaim_exit(guard, MAP_READ_SLOTS);
+    return res;
+}
+
+const void *atm_map_read_lock(atm_map *map, uint64_t key)
+{
+    // the node stays protected until the matching unlock, so its value can be read in place without a copy
+    unsigned int guard = atm_reclaim_enter(MAP_READ_SLOTS);
+    struct map_node *node = map_lookup(guard, map, key);
+    return node ? node->value : NULL;
+}
+
+void atm_map_read_unlock(atm_map *map)
+{
+    atm_reclaim_exit_last(MAP_READ_SLOTS);
+}
+
+bool atm_map_contains(atm_map *map, uint64_t key)
+{
+    unsigned int guard = atm_reclaim_enter(MAP_READ_SLOTS);
+    bool res = map_lookup(guard, map, key) != NULL;
+    atm_reclaim_exit(guard, MAP_READ_SLOTS);
+    return res;
+}
+
+static void map_lock(atm_map *map, struct map_bucket *b)
+{
+    while (atomic_exchange_explicit(&(b->lock), true, memory_order_acquire))
+    {
+        // counted with the cas retries, it is the writers' only point of contention
+        ATM_STAT_ADD(map->stats, ATM_STAT_CAS_RETRIES, 1);
+        while (atomic_load_explicit(&(b->lock), memory_order_relaxed))
+            sched_yield();
+    }
+}
+
+static void map_unlock(struct map_bucket *b)
+{
+    atomic_store_explicit(&(b->lock), false, memory_order_release);
+}
+
+static void map_push_nodes(atm_map *map, struct map_node *first, struct map_node *last)
+{
+    // push the chain first -> ... -> last onto the retired stack, nodes are linked through free_next
+    struct map_node *cur = atomic_load_explicit(&(map->retired), memory_order_relaxed);
+    atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&(map->retired), &cur, first, memory_order_release, memory_order_relaxed))
+        atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+}
+
+static void map_push_tables(atm_map *map, struct map_table *first, struct map_table *last)
+{
+    struct map_table *cur = atomic_load_explicit(&(map->retired_tables), memory_order_relaxed);
+    atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&(map->retired_tables), &cur, first, memory_order_release, memory_order_relaxed))
+        atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+}
+
+static void map_retire(atm_map *map, struct map_node *node)
+{
+    // tag the node with the epoch it was unlinked in, under epochs it can be freed once the epoch has moved on twice
+    node->retire_epoch = atm_reclaim_tag();
+    map_push_nodes(map, node, node);
+    ATM_STAT_ADD(map->stats, ATM_STAT_RETIRED, 1);
+}
+
+static void map_retire_table(atm_map *map, struct map_table *t)
+{
+    t->retire_epoch = atm_reclaim_tag();
+    map_push_tables(map, t, t);
+}
+
+static unsigned int map_migrate_bucket(atm_map *map, struct map_table *t, struct map_table *o, size_t i)
+{
+    // old buckets are always locked before new ones, writers only ever hold a new one
+    struct map_bucket *ob = &(o->buckets[i]);
+    map_lock(map, ob);
+
+    struct map_node *head = atomic_load_explicit(&(ob->head), memory_order_relaxed);
+    if (head == MAP_MOVED)
+    {
+        map_unlock(ob);
+        return 0;
+    }
+
+    // copy rather than relink, readers may still be walking the old list
+    for (struct map_node *node = head; node; node = atomic_load_explicit(&(node->next), memory_order_relaxed))
+    {
+        // readers may still be reading the value through the old node, so it is shared until both are freed
+        struct map_node *copy = map_node_new(node->key, node->value);
+        if (!node->value_refs)
+        {
+            node->value_refs = malloc(sizeof(_Atomic unsigned int));
+            atomic_store_explicit(node->value_refs, 1, memory_order_relaxed);
+        }
+        atomic_fetch_add_explicit(node->value_refs, 1, memory_order_relaxed);
+        copy->value_refs = node->value_refs;
+
+        struct map_bucket *nb = &(t->buckets[map_hash(node->key) & t->mask]);
+        map_lock(map, nb);
+        atomic_store_explicit(&(copy->next), atomic_load_explicit(&(nb->head), memory_order_relaxed), memory_order_relaxed);
+        atomic_store_explicit(&(nb->head), copy, memory_order_release);
+        map_unlock(nb);
+    }
+    atomic_store_explicit(&(ob->head), MAP_MOVED, memory_order_release);
+
+    // readers part way down the old list start over and find the bucket moved
+    unsigned int nretired = 0;
+    struct map_node *node = head;
+    while (node)
+    {
+        struct map_node *next = atomic_load_explicit(&(node->next), memory_order_relaxed);
+        atomic_store_explicit(&(node->next), map_mark(next), memory_order_release);
+        map_retire(map, node);
+        nretired++;
+        node = next;
+    }
+
+    map_unlock(ob);
+    return nretired;
+}
+
+static unsigned int map_resize_step(atm_map *map, unsigned int guard, bool check)
+{
+    struct map_table *t = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(map->table));
+    struct map_table *o = atm_reclaim_protect(guard, 1, (void *_Atomic *)&(t->prev));
+    if (!o)
+    {
+        // grow once the average chain gets long, only one writer wins the swap. Summing the stripes reads
+        // a line per stripe, so inserts only do it every ATM_MAP_COUNT_CHECK steps of their own stripe
+        if (!check || map_count(map) <= (long)((t->mask + 1) * ATM_MAP_LOAD_FACTOR))
+            return 0;
+
+        struct map_table *neo = map_table_new((t->mask + 1) * 2);
+        atomic_store_explicit(&(neo->prev), t, memory_order_relaxed);
+        if (!atomic_compare_exchange_strong_explicit(&(map->table), &t, neo, memory_order_release, memory_order_relaxed))
+        {
+            free(neo);
+            return 0;
+        }
+
+        // neither table can be retired before our share of the move below is done
+        o = t;
+        t = neo;
+    }
+
+    // claim the next few old buckets, whoever finishes the last of them unlinks the old table
+    size_t nold = o->mask + 1;
+    size_t start = atomic_fetch_add_explicit(&(t->migrate_next), ATM_MAP_MIGRATE_STEP, memory_order_relaxed);
+    if (start >= nold)
+        return 0;
+    size_t end = start + ATM_MAP_MIGRATE_STEP < nold ? start + ATM_MAP_MIGRATE_STEP : nold;
+
+    unsigned int nretired = 0;
+    for (size_t i = start; i < end; i++)
+        nretired += map_migrate_bucket(map, t, o, i);
+
+    if (atomic_fetch_add_explicit(&(t->migrate_done), end - start, memory_order_acq_rel) + (end - start) == nold)
+    {
+        atomic_store_explicit(&(t->prev), NULL, memory_order_release);
+        map_retire_table(map, o);
+    }
+    return nretired;
+}
+
+// locks the bucket that holds the key in the current table, moving its old bucket across first
+static struct map_bucket *map_lock_bucket(atm_map *map, unsigned int guard, uint64_t hash)
+{
+    while (1)
+    {
+        struct map_table *t = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(map->table));
+        struct map_table *o = atm_reclaim_protect(guard, 1, (void *_Atomic *)&(t->prev));
+        if (o)
+            map_migrate_bucket(map, t, o, hash & o->mask);
+
+        struct map_bucket *b = &(t->buckets[hash & t->mask]);
+        map_lock(map, b);
+        if (atomic_load_explicit(&(b->head), memory_order_relaxed) != MAP_MOVED)
+            return b;
+
+        // a newer resize moved this bucket before we got the lock
+        map_unlock(b);
+    }
+}
+
+static void map_maybe_reclaim(atm_map *map, unsigned int nretired)
+{
+    // once this thread has retired enough nodes, free whatever is no longer reachable,
+    // handing the pass to the background reclaimer when one is running
+    if (nretired && atm_reclaim_tick(nretired) && !atm_reclaimer_defer(&(map->deferred)))
+        atm_map_reclaim(map);
+}
+
+void atm_map_put(atm_map *map, uint64_t key, void *value)
+{
+    struct map_node *neo = map_node_new(key, value);
+    unsigned int guard = atm_reclaim_enter(MAP_WRITE_SLOTS);
+    struct map_bucket *b = map_lock_bucket(map, guard, map_hash(key));
+
+    struct map_node *_Atomic *link = &(b->head);
+    struct map_node *cur;
+    while ((cur = atomic_load_explicit(link, memory_order_relaxed)) && cur->key != key)
+        link = &(cur->next);
+
+    unsigned int nretired = 0;
+    bool check = false;
+    if (cur)
+    {
+        // swap in a replacement node, marking the old one first so readers past it start over
+        struct map_node *next = atomic_load_explicit(&(cur->next), memory_order_relaxed);
+        atomic_store_explicit(&(neo->next), next, memory_order_relaxed);
+        atomic_store_explicit(&(cur->next), map_mark(next), memory_order_release);
+        atomic_store_explicit(link, neo, memory_order_release);
+        map_retire(map, cur);
+        nretired++;
+    }
+    else
+    {
+        atomic_store_explicit(&(neo->next), atomic_load_explicit(&(b->head), memory_order_relaxed), memory_order_relaxed);
+        atomic_store_explicit(&(b->head), neo, memory_order_release);
+        check = map_count_add(map, 1) % ATM_MAP_COUNT_CHECK == 0;
+    }
+    map_unlock(b);
+
+    nretired += map_resize_step(map, guard, check);
+    atm_reclaim_exit(guard, MAP_WRITE_SLOTS);
+    map_maybe_reclaim(map, nretired);
+}
+
+bool atm_map_remove(atm_map *map, uint64_t key)
+{
+    unsigned int guard = atm_reclaim_enter(MAP_WRITE_SLOTS);
+    struct map_bucket *b = map_lock_bucket(map, guard, map_hash(key));
+
+    struct map_node *_Atomic *link = &(b->head);
+    struct map_node *cur;
+    while ((cur = atomic_load_explicit(link, memory_order_relaxed)) && cur->key != key)
+        link = &(cur->next);
+
+    unsigned int nretired = 0;
+    if (cur)
+    {
+        struct map_node *next = atomic_load_explicit(&(cur->next), memory_order_relaxed);
+        atomic_store_explicit(&(cur->next), map_mark(next), memory_order_release);
+        atomic_store_explicit(link, next, memory_order_release);
+        map_retire(map, cur);
+        map_count_add(map, -1);
+        nretired++;
+    }
+    map_unlock(b);
+
+    nretired += map_resize_step(map, guard, false);
+    atm_reclaim_exit(guard, MAP_WRITE_SLOTS);
+    map_maybe_reclaim(map, nretired);
+    return cur != NULL;
+}
+
+size_t atm_map_size(atm_map *map)
+{
+    long count = map_count(map);
+    return count > 0 ? (size_t)count : 0;
+}
+
+void atm_map_reclaim(atm_map *map)
+{
+    // take both retired stacks, whatever isn't safe yet goes back in one push keeping its original tag
+    struct map_node *node = atomic_exchange_explicit(&(map->retired), NULL, memory_order_acquire);
+    struct map_table *table = atomic_exchange_explicit(&(map->retired_tables), NULL, memory_order_acquire);
+    struct reclaim_scan scan;
+    atm_reclaim_scan_begin(&scan);
+
+    struct map_node *keep_first = NULL;
+    struct map_node *keep_last = NULL;
+    unsigned long nfreed = 0;
+    while (node)
+    {
+        struct map_node *temp = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        if (atm_reclaim_is_safe(&scan, node, node->retire_epoch))
+        {
+            free_map_node(node);
+            nfreed++;
+        }
+        else
+        {
+            atomic_store_explicit(&(node->free_next), keep_first, memory_order_relaxed);
+            if (!keep_last)
+                keep_last = node;
+            keep_first = node;
+        }
+        node = temp;
+    }
+
+    struct map_table *keep_table_first = NULL;
+    struct map_table *keep_table_last = NULL;
+    while (table)
+    {
+        struct map_table *temp = atomic_load_explicit(&(table->free_next), memory_order_relaxed);
+        if (atm_reclaim_is_safe(&scan, table, table->retire_epoch))
+            free_map_table(table);
+        else
+        {
+            atomic_store_explicit(&(table->free_next), keep_table_first, memory_order_relaxed);
+            if (!keep_table_last)
+                keep_table_last = table;
+            keep_table_first = table;
+        }
+        table = temp;
+    }
+
+    atm_reclaim_scan_end(&scan);
+
+    if (keep_first)
+        map_push_nodes(map, keep_first, keep_last);
+    if (keep_table_first)
+        map_push_tables(map, keep_table_first, keep_table_last);
+    ATM_STAT_ADD(map->stats, ATM_STAT_FREED, nfreed);
+}
+
+void atm_map_stats(atm_map *map, struct atm_stats *out)
+{
+#ifdef ATM_STATS
+    atm_stats_collect(map->stats, out);
+#else
+    *out = (struct atm_stats) { 0 };
+#endif
+}
+
+void free_atm_map(atm_map *map)
+{
+    free_atm_map_auto(map);
+    free(map);
+}
+
+void free_atm_map_auto(atm_map *map)
+{
+    atm_reclaimer_cancel(&(map->deferred));
+
+    struct map_node *node = atomic_exchange_explicit(&(map->retired), NULL, memory_order_relaxed);
+    while (node)
+    {
+        struct map_node *temp = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        free_map_node(node);
+        node = temp;
+    }
+
+    struct map_table *table = atomic_exchange_explicit(&(map->retired_tables), NULL, memory_order_relaxed);
+    while (table)
+    {
+        struct map_table *temp = atomic_load_explicit(&(table->free_next), memory_order_relaxed);
+        free_map_table(table);
+        table = temp;
+    }
+
+    // a resize may still be part way through, the old table holds whatever hasn't moved yet
+    struct map_table *t = atomic_exchange_explicit(&(map->table), NULL, memory_order_relaxed);
+    struct map_table *o = atomic_load_explicit(&(t->prev), memory_order_relaxed);
+    if (o)
+        free_map_table(o);
+    free_map_table(t);
+}
@@ -0,0 +1,111 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "multi_queue.h"
+
+// every thread gets its own random stream and a home shard, handed out round robin on first use
+static _Atomic unsigned long multi_queue_next_thread = 0;
+static _Thread_local uint64_t multi_queue_rng = 0;
+static _Thread_local unsigned long multi_queue_home = 0;
+
+static uint64_t multi_queue_random(void)
+{
+    if (!multi_queue_rng)
+    {
+        multi_queue_home = atomic_fetch_add_explicit(&multi_queue_next_thread, 1, memory_order_relaxed);
+        multi_queue_rng = (multi_queue_home + 1) * 0x9E3779B97F4A7C15ULL;
+    }
+
+    // xorshift64, plenty for picking shards
+    multi_queue_rng ^= multi_queue_rng << 13;
+    multi_queue_rng ^= multi_queue_rng >> 7;
+    multi_queue_rng ^= multi_queue_rng << 17;
+    return multi_queue_rng;
+}
+
+static size_t multi_queue_home_shard(atm_multi_queue *mq)
+{
+    if (!multi_queue_rng)
+        multi_queue_random();
+    return multi_queue_home % mq->nshards;
+}
+
+void atm_multi_queue_init(atm_multi_queue *mq, size_t nshards)
+{
+    if (nshards == 0)
+        nshards = 1;
+
+    // shards are padded to whole cache lines, so they need an aligned allocation
+    mq->shards = aligned_alloc(ATM_CACHE_LINE, nshards * sizeof(struct multi_queue_shard));
+    mq->nshards = nshards;
+    for (size_t i = 0; i < nshards; i++)
+    {
+        atm_queue_init(&(mq->shards[i].q));
+        atomic_store_explicit(&(mq->shards[i].size), 0, memory_order_relaxed);
+    }
+}
+
+void atm_multi_queue_enqueue(atm_multi_queue *mq, void *data)
+{
+    // producers stick to their home shard, so threads on different shards never touch the same tail
+    struct multi_queue_shard *shard = &(mq->shards[multi_queue_home_shard(mq)]);
+    atm_queue_enqueue(&(shard->q), data);
+    atomic_fetch_add_explicit(&(shard->size), 1, memory_order_relaxed);
+}
+
+static void *multi_queue_try_shard(struct multi_queue_shard *shard)
+{
+    void *res = atm_queue_dequeue(&(shard->q));
+    if (res)
+        atomic_fetch_sub_explicit(&(shard->size), 1, memory_order_relaxed);
+    return res;
+}
+
+void *atm_multi_queue_dequeue(atm_multi_queue *mq)
+{
+    size_t home = multi_queue_home_shard(mq);
+    if (mq->nshards == 1)
+        return multi_queue_try_shard(&(mq->shards[0]));
+
+    // power of two choices, compare the home shard with a random one and take from the fuller
+    size_t other = multi_queue_random() % mq->nshards;
+    size_t first = home;
+    if (other != home &&
+        atomic_load_explicit(&(mq->shards[other].size), memory_order_relaxed) > atomic_load_explicit(&(mq->shards[home].size), memory_order_relaxed))
+        first = other;
+
+    void *res = multi_queue_try_shard(&(mq->shards[first]));
+    if (res)
+        return res;
+
+    // the chosen shard was empty, steal from the rest starting at a random shard so thieves spread out
+    size_t start = multi_queue_random() % mq->nshards;
+    for (size_t i = 0; i < mq->nshards; i++)
+    {
+        size_t idx = (start + i) % mq->nshards;
+        if (idx == first)
+            continue;
+        if ((res = multi_queue_try_shard(&(mq->shards[idx]))))
+            return res;
+    }
+
+    return NULL;
+}
+
+void free_atm_multi_queue(atm_multi_queue *mq)
+{
+    free_atm_multi_queue_auto(mq);
+    free(mq);
+}
+
+void free_atm_multi_queue_auto(atm_multi_queue *mq)
+{
+    // like atm_queue, items still queued are owned by the container
+    for (size_t i = 0; i < mq->nshards; i++)
+        free_atm_queue_auto(&(mq->shards[i].q));
+    free(mq->shards);
+    mq->shards = NULL;
+    mq->nshards = 0;
+}
@@ -2,13 +2,25 @@
 #include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <sched.h>
+#endif
 
 #include "queue.h"
+#include "reclaim.h"
 
 void queue_node_init(struct queue_node *node, void *data)
 {
     atomic_store_explicit(&(node->data), data, memory_order_relaxed);
     atomic_store_explicit(&(node->next), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(node->free_next), NULL, memory_order_relaxed);
+    node->retire_epoch = 0;
 }
 
 void free_queue_node(struct queue_node *node)
@@ -20,132 +32,425 @@ void free_queue_node(struct queue_node *node)
     free(node);
 }
 
-void queue_epoch_node_init(struct queue_epoch_node *node, struct queue_node *data)
-{
-    node->data = data;
-    node->next = NULL;
-}
-
-void free_queue_epoch_node(struct queue_epoch_node *restrict node)
+void free_queue_node_list(struct queue_node *node)
 {
+    // frees a chain of nodes linked through free_next, as found on the pool and retired stack
     while (node)
     {
-        struct queue_epoch_node *temp = node->next;
-        node->next = NULL;
-        if (node->data)
-        {
-            free_queue_node(node->data);
-            node->data = NULL;
-        }
-        free(node);
+        struct queue_node *temp = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        free_queue_node(node);
         node = temp;
     }
 }
 
+static void atm_queue_reclaim_deferred(void *arg)
+{
+    atm_queue_reclaim((atm_queue *)arg);
+}
+
 void atm_queue_init(atm_queue *q)
 {
-    q->state = 0;
-    q->epoch_flag = false;
     struct queue_node *init = malloc(sizeof(struct queue_node));
     queue_node_init(init, NULL);
     q->head = init;
     q->tail = init;
-    q->cur_epoch_stack = NULL;
-    q->final_epoch_stack = NULL;
+    q->retired = NULL;
+    q->free_nodes = NULL;
+    q->waiters = 0;
+    q->wake_seq = 0;
+    atm_deferred_init(&(q->deferred), atm_queue_reclaim_deferred, q);
+#ifdef ATM_STATS
+    atm_stats_init(q->stats);
+#endif
 }
 
-void atm_queue_enqueue(atm_queue *q, void *data)
+static void atm_queue_futex_wait(_Atomic unsigned int *addr, unsigned int val, const struct timespec *timeout)
+{
+#ifdef __linux__
+    // returns straight away if addr no longer holds val, so a wake between our check and this call isn't lost
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+#else
+    sched_yield();
+#endif
+}
+
+static void atm_queue_futex_wake(_Atomic unsigned int *addr, int n)
+{
+#ifdef __linux__
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+#endif
+}
+
+static void atm_queue_notify(atm_queue *q, int n)
+{
+    // the link onto the tail is seq_cst so this load can't be reordered before it, in the
+    // common case nobody is parked and this is the only cost a producer pays
+    if (atomic_load_explicit(&(q->waiters), memory_order_seq_cst) == 0)
+        return;
+
+    atomic_fetch_add_explicit(&(q->wake_seq), 1, memory_order_release);
+    atm_queue_futex_wake(&(q->wake_seq), n);
+}
+
+static void atm_queue_maybe_reclaim(atm_queue *q, unsigned int nretired)
+{
+    // once this thread has retired enough nodes, recycle whatever is no longer reachable,
+    // handing the pass to the background reclaimer when one is running
+    if (nretired && atm_reclaim_tick(nretired) && !atm_reclaimer_defer(&(q->deferred)))
+        atm_queue_reclaim(q);
+}
+
+struct queue_node *atm_queue_alloc_node(atm_queue *q, void *data)
+{
+    // the top of the pool stays protected while we read its link, a popped node can't
+    // re-enter the pool while another thread still protects it, so the pop is safe from ABA
+    unsigned int guard = atm_reclaim_enter(1);
+    struct queue_node *node;
+    while ((node = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(q->free_nodes))))
+    {
+        struct queue_node *next = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        struct queue_node *expected = node;
+        if (atomic_compare_exchange_weak_explicit(&(q->free_nodes), &expected, next, memory_order_acquire, memory_order_relaxed))
+            break;
+        ATM_STAT_ADD(q->stats, ATM_STAT_CAS_RETRIES, 1);
+    }
+    atm_reclaim_exit(guard, 1);
+
+    // pool is empty, fall back to the heap
+    if (!node)
+        node = malloc(sizeof(struct queue_node));
+
+    queue_node_init(node, data);
+    return node;
+}
+
+void atm_queue_release_nodes(atm_queue *q, struct queue_node *first, struct queue_node *last)
 {
-    // create new node for the queue
-    struct queue_node *neo = malloc(sizeof(struct queue_node));
-    queue_node_init(neo, data);
+    // push the chain first -> ... -> last onto the pool, nodes are linked through free_next
+    struct queue_node *cur = atomic_load_explicit(&(q->free_nodes), memory_order_relaxed);
+    atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+
+    while (!atomic_compare_exchange_weak_explicit(&(q->free_nodes), &cur, first, memory_order_release, memory_order_relaxed))
+        atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+}
 
+static struct queue_node *atm_queue_alloc_chain(atm_queue *q, void **items, size_t n, struct queue_node **last)
+{
+    // take the whole pool with a single exchange rather than paying a CAS per node, the pool can't see ABA this way
+    struct queue_node *pool = atomic_exchange_explicit(&(q->free_nodes), NULL, memory_order_acquire);
+    struct queue_node *first = NULL;
+    struct queue_node *prev = NULL;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        struct queue_node *node = pool;
+        if (node)
+            pool = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        else
+            node = malloc(sizeof(struct queue_node));
+
+        // link the chain privately, it is published by the CAS onto the tail
+        queue_node_init(node, items[i]);
+        if (prev)
+            atomic_store_explicit(&(prev->next), node, memory_order_relaxed);
+        else
+            first = node;
+        prev = node;
+    }
+
+    // hand back whatever we didn't use, usually the pool is still empty so no walk is required
+    struct queue_node *expected = NULL;
+    if (pool && !atomic_compare_exchange_strong_explicit(&(q->free_nodes), &expected, pool, memory_order_release, memory_order_relaxed))
+    {
+        struct queue_node *pool_last = pool;
+        struct queue_node *temp;
+        while ((temp = atomic_load_explicit(&(pool_last->free_next), memory_order_relaxed)))
+            pool_last = temp;
+        atm_queue_release_nodes(q, pool, pool_last);
+    }
+
+    *last = prev;
+    return first;
+}
+
+static void atm_queue_link_tail(atm_queue *q, unsigned int guard, struct queue_node *first, struct queue_node *last)
+{
     while (1)
     {
         // load current tail and attempt to replace it's next pointer
-        struct queue_node *cur_tail = atomic_load_explicit(&(q->tail), memory_order_acquire);
-        struct queue_node *cur_tail_next = NULL;
-        if (atomic_compare_exchange_strong_explicit(&(cur_tail->next), &cur_tail_next, neo, memory_order_relaxed, memory_order_relaxed))
+        struct queue_node *cur_tail = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(q->tail));
+        struct queue_node *cur_tail_next = atomic_load_explicit(&(cur_tail->next), memory_order_acquire);
+        if (cur_tail_next != NULL)
+        {
+            // the tail is lagging behind, help it along before trying again
+            atomic_compare_exchange_strong_explicit(&(q->tail), &cur_tail, cur_tail_next, memory_order_release, memory_order_relaxed);
+            ATM_STAT_ADD(q->stats, ATM_STAT_CAS_RETRIES, 1);
+            continue;
+        }
+
+        if (atomic_compare_exchange_strong_explicit(&(cur_tail->next), &cur_tail_next, first, memory_order_seq_cst, memory_order_relaxed))
         {
-            // only the thread that is successful at updating the next pointer of tail gets to update the tail
-            atomic_store_explicit(&(q->tail), neo, memory_order_release);
+            // swing the tail to the end of the chain, if this fails another thread has already helped it along
+            atomic_compare_exchange_strong_explicit(&(q->tail), &cur_tail, last, memory_order_release, memory_order_relaxed);
             break;
         }
+        ATM_STAT_ADD(q->stats, ATM_STAT_CAS_RETRIES, 1);
     }
 }
 
-void *atm_queue_dequeue(atm_queue *q)
+static void *atm_queue_claim(atm_queue *q, unsigned int guard, struct queue_node **retired)
 {
-    // increment state, to notify other threads data is being read 
-    atomic_fetch_add_explicit(&(q->state), 1, memory_order_relaxed);
-    void *res = NULL;
-
     while (1)
     {
         // read current data held in head, this pointer will never be null
-        struct queue_node *cur_head = atomic_load_explicit(&(q->head), memory_order_acquire);
-        struct queue_node *cur_head_next = atomic_load_explicit(&(cur_head->next), memory_order_relaxed);
+        struct queue_node *cur_head = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(q->head));
+        struct queue_node *cur_head_next = atomic_load_explicit(&(cur_head->next), memory_order_acquire);
         if (cur_head_next == NULL)
         {
             // we have an empty queue, sentinel node points to NULL
-            break;
+            return NULL;
         }
 
+        // protect the next node too, it is only guaranteed to still be linked while head hasn't moved
+        atm_reclaim_hold(guard, 1, cur_head_next);
+        if (atomic_load_explicit(&(q->head), memory_order_acquire) != cur_head)
+            continue;
+
+        // never retire a node the tail still points at, help the tail past it first
+        struct queue_node *cur_tail = atomic_load_explicit(&(q->tail), memory_order_acquire);
+        if (cur_tail == cur_head)
+            atomic_compare_exchange_strong_explicit(&(q->tail), &cur_tail, cur_head_next, memory_order_release, memory_order_relaxed);
+
         // for exchanging with the next nodes data
         void *cur_data = atomic_exchange_explicit(&(cur_head_next->data), NULL, memory_order_relaxed);
         if (cur_data != NULL)
         {
-            // this thread gets to update the current head of the queue
-            res = cur_data;
-            atm_queue_push_epoch(q, cur_head);
-
-            // now update head of the queue
+            // this thread gets to update the current head of the queue, the old head is handed back for retirement
+            *retired = cur_head;
             atomic_store_explicit(&(q->head), cur_head_next, memory_order_release);
-            break;
-        }       
+            return cur_data;
+        }
     }
+}
+
+static void atm_queue_push_retired(atm_queue *q, struct queue_node *first, struct queue_node *last)
+{
+    // retired nodes are chained through their own free_next field, no separate bookkeeping node is needed
+    struct queue_node *cur_stack = atomic_load_explicit(&(q->retired), memory_order_relaxed);
+    atomic_store_explicit(&(last->free_next), cur_stack, memory_order_relaxed);
 
-    // exit the read state
-    if (
-        atomic_fetch_sub_explicit(&(q->state), 1, memory_order_release) == 1 &&
-        !atomic_exchange_explicit(&(q->epoch_flag), true, memory_order_release)
-    )
+    while (!atomic_compare_exchange_weak_explicit(&(q->retired), &cur_stack, first, memory_order_release, memory_order_relaxed))
     {
-        // if we enter this block acquire on all previous release updates to state and epoch flag
-        atomic_thread_fence(memory_order_acquire);
+        atomic_store_explicit(&(last->free_next), cur_stack, memory_order_relaxed);
+        ATM_STAT_ADD(q->stats, ATM_STAT_CAS_RETRIES, 1);
+    }
+}
 
-        struct queue_epoch_node *old_cur_epoch_stack = atomic_exchange_explicit(&(q->cur_epoch_stack), NULL, memory_order_relaxed);
-        struct queue_epoch_node *old_final_epoch_stack = atomic_exchange_explicit(&(q->final_epoch_stack), old_cur_epoch_stack, memory_order_relaxed);
+void atm_queue_enqueue(atm_queue *q, void *data)
+{
+    // the tail has to stay protected while we link onto it
+    unsigned int guard = atm_reclaim_enter(1);
 
-        // free nodes in the current epoch
-        free_queue_epoch_node(old_final_epoch_stack);
+    // take a node for the queue from the pool
+    struct queue_node *neo = atm_queue_alloc_node(q, data);
+    atm_queue_link_tail(q, guard, neo, neo);
 
-        // finally reset epoch flag
-        atomic_store_explicit(&(q->epoch_flag), false, memory_order_release);
-    }
+    atm_reclaim_exit(guard, 1);
+    atm_queue_notify(q, 1);
+}
+
+void atm_queue_enqueue_bulk(atm_queue *q, void **items, size_t n)
+{
+    if (n == 0)
+        return;
+
+    unsigned int guard = atm_reclaim_enter(1);
+
+    // build the whole chain privately then splice it onto the tail with one CAS
+    struct queue_node *last;
+    struct queue_node *first = atm_queue_alloc_chain(q, items, n, &last);
+    atm_queue_link_tail(q, guard, first, last);
+
+    atm_reclaim_exit(guard, 1);
+    atm_queue_notify(q, n > INT_MAX ? INT_MAX : (int)n);
+}
+
+void *atm_queue_dequeue(atm_queue *q)
+{
+    // protects the head and the node after it
+    unsigned int guard = atm_reclaim_enter(2);
+
+    struct queue_node *retired = NULL;
+    void *res = atm_queue_claim(q, guard, &retired);
+    if (res)
+        atm_queue_push_epoch(q, retired);
+    else
+        ATM_STAT_ADD(q->stats, ATM_STAT_EMPTY_DEQUEUES, 1);
+
+    atm_reclaim_exit(guard, 2);
+    atm_queue_maybe_reclaim(q, res != NULL);
 
     return res;
 }
 
+size_t atm_queue_dequeue_bulk(atm_queue *q, void **out, size_t max)
+{
+    if (max == 0)
+        return 0;
+
+    // claim every item under a single enter and exit
+    unsigned int guard = atm_reclaim_enter(2);
+
+    struct queue_node *first = NULL;
+    struct queue_node *last = NULL;
+    size_t n = 0;
+
+    while (n < max)
+    {
+        struct queue_node *retired = NULL;
+        void *res = atm_queue_claim(q, guard, &retired);
+        if (!res)
+            break;
+
+        // collect retired heads privately so they can be pushed onto the retired stack together
+        out[n++] = res;
+        atomic_store_explicit(&(retired->free_next), first, memory_order_relaxed);
+        if (!last)
+            last = retired;
+        first = retired;
+    }
+
+    if (first)
+    {
+        // every node was unlinked before this point, so they can all share one retire tag
+        unsigned long epoch = atm_reclaim_tag();
+        for (struct queue_node *node = first; node != last; node = atomic_load_explicit(&(node->free_next), memory_order_relaxed))
+            node->retire_epoch = epoch;
+        last->retire_epoch = epoch;
+        atm_queue_push_retired(q, first, last);
+        ATM_STAT_ADD(q->stats, ATM_STAT_RETIRED, n);
+    }
+    else
+        ATM_STAT_ADD(q->stats, ATM_STAT_EMPTY_DEQUEUES, 1);
+
+    atm_reclaim_exit(guard, 2);
+    atm_queue_maybe_reclaim(q, n);
+
+    return n;
+}
+
+void *atm_queue_dequeue_wait(atm_queue *q, long long timeout_ns)
+{
+    // a short spin catches items that are about to arrive without paying for a syscall
+    void *res;
+    for (int i = 0; i < ATM_QUEUE_WAIT_SPINS; i++)
+        if ((res = atm_queue_dequeue(q)))
+            return res;
+
+    // a negative timeout waits for as long as it takes
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    long long deadline_ns = (long long)deadline.tv_sec * 1000000000LL + deadline.tv_nsec + timeout_ns;
+
+    while (1)
+    {
+        struct timespec remaining;
+        struct timespec *timeout = NULL;
+        if (timeout_ns >= 0)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long long left = deadline_ns - ((long long)now.tv_sec * 1000000000LL + now.tv_nsec);
+            if (left <= 0)
+                return NULL;
+            remaining.tv_sec = left / 1000000000LL;
+            remaining.tv_nsec = left % 1000000000LL;
+            timeout = &remaining;
+        }
+
+        // register as a waiter before the final check, a producer either sees us or we see its item
+        atomic_fetch_add_explicit(&(q->waiters), 1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        unsigned int seq = atomic_load_explicit(&(q->wake_seq), memory_order_acquire);
+
+        res = atm_queue_dequeue(q);
+        if (!res)
+            atm_queue_futex_wait(&(q->wake_seq), seq, timeout);
+
+        atomic_fetch_sub_explicit(&(q->waiters), 1, memory_order_relaxed);
+
+        if (res || (res = atm_queue_dequeue(q)))
+            return res;
+    }
+}
+
 void atm_queue_push_epoch(atm_queue *q, struct queue_node *node)
 {
-    // create new epoch node to add to the current epoch stack
-    struct queue_epoch_node *neo = malloc(sizeof(struct queue_epoch_node));
-    queue_epoch_node_init(neo, node);
+    // tag the node with the epoch it was unlinked in, under epochs it can be recycled once the epoch has moved on twice
+    node->retire_epoch = atm_reclaim_tag();
+    atm_queue_push_retired(q, node, node);
+    ATM_STAT_ADD(q->stats, ATM_STAT_RETIRED, 1);
+}
+
+void atm_queue_reclaim(atm_queue *q)
+{
+    // take the whole retired stack, nodes that aren't safe yet get pushed back
+    struct queue_node *node = atomic_exchange_explicit(&(q->retired), NULL, memory_order_acquire);
+    struct reclaim_scan scan;
+    atm_reclaim_scan_begin(&scan);
 
-    struct queue_epoch_node *cur_stack = atomic_load_explicit(&(q->cur_epoch_stack), memory_order_relaxed);
-    neo->next = cur_stack;
+    struct queue_node *safe_first = NULL;
+    struct queue_node *safe_last = NULL;
+    struct queue_node *keep_first = NULL;
+    struct queue_node *keep_last = NULL;
+    unsigned long nfreed = 0;
 
-    while (!atomic_compare_exchange_strong_explicit(&(q->cur_epoch_stack), &cur_stack, neo, memory_order_relaxed, memory_order_relaxed))
-        neo->next = cur_stack;
+    while (node)
+    {
+        struct queue_node *temp = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        if (atm_reclaim_is_safe(&scan, node, node->retire_epoch))
+        {
+            nfreed++;
+            atomic_store_explicit(&(node->free_next), safe_first, memory_order_relaxed);
+            if (!safe_last)
+                safe_last = node;
+            safe_first = node;
+        }
+        else
+        {
+            atomic_store_explicit(&(node->free_next), keep_first, memory_order_relaxed);
+            if (!keep_last)
+                keep_last = node;
+            keep_first = node;
+        }
+        node = temp;
+    }
+
+    atm_reclaim_scan_end(&scan);
+
+    if (keep_first)
+        atm_queue_push_retired(q, keep_first, keep_last);
+
+    // no thread can still see these nodes, return them to the pool
+    if (safe_first)
+        atm_queue_release_nodes(q, safe_first, safe_last);
+    ATM_STAT_ADD(q->stats, ATM_STAT_FREED, nfreed);
+}
+
+void atm_queue_stats(atm_queue *q, struct atm_stats *out)
+{
+#ifdef ATM_STATS
+    atm_stats_collect(q->stats, out);
+#else
+    *out = (struct atm_stats) { 0 };
+#endif
 }
 
 void free_atm_queue(atm_queue *q)
 {
-    struct queue_epoch_node *old_final_epoch_stack = atomic_exchange_explicit(&(q->final_epoch_stack), NULL, memory_order_relaxed);
-    free_queue_epoch_node(old_final_epoch_stack);
-    struct queue_epoch_node *old_cur_epoch_stack = atomic_exchange_explicit(&(q->cur_epoch_stack), NULL, memory_order_relaxed);
-    free_queue_epoch_node(old_cur_epoch_stack);
+    atm_reclaimer_cancel(&(q->deferred));
+    struct queue_node *old_retired = atomic_exchange_explicit(&(q->retired), NULL, memory_order_relaxed);
+    free_queue_node_list(old_retired);
 
     struct queue_node *cur = atomic_load_explicit(&(q->head), memory_order_relaxed);
     while (cur)
@@ -155,15 +460,16 @@ void free_atm_queue(atm_queue *q)
         cur = temp;
     }
 
+    free_queue_node_list(atomic_exchange_explicit(&(q->free_nodes), NULL, memory_order_relaxed));
+
     free(q);
 }
 
 void free_atm_queue_auto(atm_queue *q)
 {
-    struct queue_epoch_node *old_final_epoch_stack = atomic_exchange_explicit(&(q->final_epoch_stack), NULL, memory_order_relaxed);
-    free_queue_epoch_node(old_final_epoch_stack);
-    struct queue_epoch_node *old_cur_epoch_stack = atomic_exchange_explicit(&(q->cur_epoch_stack), NULL, memory_order_relaxed);
-    free_queue_epoch_node(old_cur_epoch_stack);
+    atm_reclaimer_cancel(&(q->deferred));
+    struct queue_node *old_retired = atomic_exchange_explicit(&(q->retired), NULL, memory_order_relaxed);
+    free_queue_node_list(old_retired);
 
     struct queue_node *cur = atomic_load_explicit(&(q->head), memory_order_relaxed);
     while (cur)
@@ -172,4 +478,6 @@ void free_atm_queue_auto(atm_queue *q)
         free_queue_node(cur);
         cur = temp;
     }
+
+    free_queue_node_list(atomic_exchange_explicit(&(q->free_nodes), NULL, memory_order_relaxed));
 }
\ No newline at end of file
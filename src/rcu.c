@@ -2,18 +2,17 @@
 #include <stdlib.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <sched.h>
 #include "rcu.h"
+#include "reclaim.h"
 
 
 void rcunode_init(rcunode_t *node, void *data)
 {
     node->data_ptr = data;
-    node->ref_count = 1;
-}
-
-void rcunode_inc_ref_count(rcunode_t *node)
-{
-    atomic_fetch_add_explicit(&(node->ref_count), 1, memory_order_relaxed);
+    node->next = NULL;
+    node->retire_epoch = 0;
+    node->version = 0;
 }
 
 void *rcunode_cpy(rcunode_t *node, void *(*cpy)(void*))
@@ -23,122 +22,397 @@ void *rcunode_cpy(rcunode_t *node, void *(*cpy)(void*))
 
 void free_rcunode(rcunode_t *node)
 {
-    if (atomic_fetch_sub_explicit(&(node->ref_count), 1, memory_order_release) == 1)
+    // only called once reclamation has established no reader can still see the node
+    free(node->data_ptr);
+    node->data_ptr = NULL;
+    free(node);
+}
+
+void free_rcunode_stack(rcunode_t *node)
+{
+    // retired nodes are chained intrusively through their next field
+    while (node)
     {
-        // match all previous releases to ensure we get the correct memory ordering
-        atomic_thread_fence(memory_order_acquire);
-        free(node->data_ptr);
-        node->data_ptr = NULL;
-        free(node);
+        rcunode_t *temp = node->next;
+        node->next = NULL;
+        free_rcunode(node);
+        node = temp;
     }
 }
 
-void rcu_stack_node_init(struct rcu_stack_node *sn, rcunode_t *data)
+static void rcu_reclaim_deferred(void *arg)
 {
-    sn->data = data;
-    sn->next = NULL;
+    rcu_reclaim((rcu_t *)arg);
 }
 
-void free_rcu_stack_node(struct rcu_stack_node *restrict sn)
+static void rcu_maybe_reclaim(rcu_t *rcu)
 {
-    while (sn)
-    {
-        struct rcu_stack_node *temp = sn->next;
-        sn->next = NULL;
-        if (sn->data)
-            free_rcunode(sn->data);
-        free(sn);
-        sn = temp;
-    }
+    // once this thread has retired enough nodes, free whatever is no longer reachable,
+    // handing the pass to the background reclaimer when one is running
+    if (atm_reclaim_tick(1) && !atm_reclaimer_defer(&(rcu->deferred)))
+        rcu_reclaim(rcu);
 }
 
 void rcu_init(rcu_t *rcu, void *(*cpy)(void*))
 {
-    rcu->state = 0;
-    rcu->epoch_flag = false;
     rcu->data = NULL;
-    rcu->cur_epoch_stack = NULL;
-    rcu->final_epoch_stack = NULL;
+    rcu->retired = NULL;
     rcu->cpy = cpy;
+    rcu->requests = NULL;
+    rcu->combining = false;
+    atm_deferred_init(&(rcu->deferred), rcu_reclaim_deferred, rcu);
+#ifdef ATM_STATS
+    atm_stats_init(rcu->stats);
+#endif
 }
 
 void rcu_init_with(rcu_t *rcu, void *(*cpy)(void*), void *data)
 {
-    rcu->state = 0;
-    rcu->epoch_flag = false;
     rcu->data = malloc(sizeof(rcunode_t));
     rcunode_init(rcu->data, data);
-    rcu->cur_epoch_stack = NULL;
-    rcu->final_epoch_stack = NULL;
+    rcu->data->version = 1;
+    rcu->retired = NULL;
     rcu->cpy = cpy;
+    rcu->requests = NULL;
+    rcu->combining = false;
+    atm_deferred_init(&(rcu->deferred), rcu_reclaim_deferred, rcu);
+#ifdef ATM_STATS
+    atm_stats_init(rcu->stats);
+#endif
 }
 
 void *rcu_read(rcu_t *rcu)
 {
-    atomic_fetch_add_explicit(&(rcu->state), 1, memory_order_relaxed);
+    // protect the node we load so it can't be reclaimed while we copy out of it. Readers only
+    // ever write their own slot, there is no shared counter or reference count to bounce between cores
+    unsigned int guard = atm_reclaim_enter(1);
 
     // read the whatever data is current
-    rcunode_t *cur = atomic_load_explicit(&(rcu->data), memory_order_relaxed);
-    if (cur)
-        rcunode_inc_ref_count(cur);
+    rcunode_t *cur = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(rcu->data));
+    void *res = cur ? rcu->cpy(cur->data_ptr) : NULL;
+
+    atm_reclaim_exit(guard, 1);
+
+    return res;
+}
+
+void *rcu_read_versioned(rcu_t *rcu, unsigned long *version)
+{
+    // versions start at 1 with the first published data, 0 means nothing has been published yet
+    unsigned int guard = atm_reclaim_enter(1);
+
+    rcunode_t *cur = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(rcu->data));
+    void *res = cur ? rcu->cpy(cur->data_ptr) : NULL;
+    *version = cur ? cur->version : 0;
+
+    atm_reclaim_exit(guard, 1);
+
+    return res;
+}
+
+unsigned long rcu_version(rcu_t *rcu)
+{
+    // lets a reader check for a newer version without paying for a copy
+    unsigned int guard = atm_reclaim_enter(1);
+    rcunode_t *cur = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(rcu->data));
+    unsigned long version = cur ? cur->version : 0;
+    atm_reclaim_exit(guard, 1);
+
+    return version;
+}
+
+const void *rcu_read_lock(rcu_t *rcu)
+{
+    // the node stays protected until the matching unlock, so its data can be read in place without a copy
+    unsigned int guard = atm_reclaim_enter(1);
+    rcunode_t *cur = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(rcu->data));
+    return cur ? cur->data_ptr : NULL;
+}
+
+void rcu_read_unlock(rcu_t *rcu)
+{
+    atm_reclaim_exit_last(1);
+}
+
+void rcu_update(rcu_t *rcu, void *data)
+{
+    rcunode_t *neo = malloc(sizeof(rcunode_t));
+    rcunode_init(neo, data);
 
-    // update the state, check if new epoch should begin
-    if (
-        atomic_fetch_sub_explicit(&(rcu->state), 1, memory_order_release) == 1 &&
-        !atomic_exchange_explicit(&(rcu->epoch_flag), true, memory_order_release)
-    )
+    // keep attempting to update untill successful, the current node stays protected while we read its version
+    unsigned int guard = atm_reclaim_enter(1);
+    rcunode_t *cur;
+    while (1)
     {
-        // synchronizes with all previous release subs and stores/exchanges
-        atomic_thread_fence(memory_order_acquire);
-        struct rcu_stack_node *old_cur_epoch_stack = atomic_exchange_explicit(&(rcu->cur_epoch_stack), NULL, memory_order_relaxed);
-        struct rcu_stack_node *old_final_epoch_stack = atomic_exchange_explicit(&(rcu->final_epoch_stack), old_cur_epoch_stack, memory_order_relaxed);
-        // free old final epoch stack
-        free_rcu_stack_node(old_final_epoch_stack);
-        atomic_store_explicit(&(rcu->epoch_flag), false, memory_order_release);
+        cur = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(rcu->data));
+        neo->version = cur ? cur->version + 1 : 1;
+        if (atomic_compare_exchange_strong_explicit(&(rcu->data), &cur, neo, memory_order_release, memory_order_relaxed))
+            break;
+        ATM_STAT_ADD(rcu->stats, ATM_STAT_CAS_RETRIES, 1);
     }
+    atm_reclaim_exit(guard, 1);
 
+    // push the node that was original current data onto the retired stack
     if (cur)
     {
-        // copy data out from current node
-        void *res = rcu->cpy(cur->data_ptr);
-        free_rcunode(cur);
-        return res;
+        rcu_push(rcu, cur);
+        rcu_maybe_reclaim(rcu);
+    }
+}
+
+bool rcu_update_fn(rcu_t *rcu, void (*mutate)(void*, void*), void *ctx)
+{
+    rcunode_t *neo = malloc(sizeof(rcunode_t));
+    rcunode_t *cur;
+
+    // the current node stays protected while we copy it, so it can't be reclaimed and reused under us
+    unsigned int guard = atm_reclaim_enter(1);
+    while (1)
+    {
+        cur = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(rcu->data));
+        if (!cur)
+        {
+            // nothing has been published yet, there is no version to mutate
+            atm_reclaim_exit(guard, 1);
+            free(neo);
+            return false;
+        }
+
+        void *copy = rcu->cpy(cur->data_ptr);
+        mutate(copy, ctx);
+        rcunode_init(neo, copy);
+        neo->version = cur->version + 1;
+
+        // only publish if the version we copied is still current, otherwise start again from the newer one
+        if (atomic_compare_exchange_strong_explicit(&(rcu->data), &cur, neo, memory_order_release, memory_order_relaxed))
+            break;
+
+        free(copy);
+        ATM_STAT_ADD(rcu->stats, ATM_STAT_CAS_RETRIES, 1);
     }
+    atm_reclaim_exit(guard, 1);
+
+    rcu_push(rcu, cur);
+    rcu_maybe_reclaim(rcu);
 
-    return NULL;
+    return true;
 }
 
-void rcu_update(rcu_t *rcu, void *data)
+bool rcu_update_if(rcu_t *rcu, void *data, unsigned long expected_version)
 {
+    // protect the current node so its version can be read and it can't be freed and its address reused before the CAS
+    unsigned int guard = atm_reclaim_enter(1);
+    rcunode_t *cur = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(rcu->data));
+    if ((cur ? cur->version : 0) != expected_version)
+    {
+        // something newer was published, data stays with the caller
+        atm_reclaim_exit(guard, 1);
+        return false;
+    }
+
     rcunode_t *neo = malloc(sizeof(rcunode_t));
     rcunode_init(neo, data);
+    neo->version = expected_version + 1;
+
+    // versions only ever grow, so a failed CAS always means a newer version went in first
+    if (!atomic_compare_exchange_strong_explicit(&(rcu->data), &cur, neo, memory_order_release, memory_order_relaxed))
+    {
+        atm_reclaim_exit(guard, 1);
+        free(neo);
+        return false;
+    }
+    atm_reclaim_exit(guard, 1);
 
-    // keep attempting to update untill successful
-    rcunode_t *cur = atomic_load_explicit(&(rcu->data), memory_order_relaxed);
-    while (!atomic_compare_exchange_strong_explicit(&(rcu->data), &cur, neo, memory_order_relaxed, memory_order_relaxed));
+    if (cur)
+    {
+        rcu_push(rcu, cur);
+        rcu_maybe_reclaim(rcu);
+    }
 
-    // push the node that was original current data onto cur epoch stack
-    rcu_push(rcu, cur);
+    return true;
+}
+
+// number of times a waiting updater checks its request before yielding to a possibly preempted combiner
+#ifndef RCU_COMBINE_SPINS
+#define RCU_COMBINE_SPINS 64
+#endif
+
+enum {
+    RCU_REQUEST_PENDING,
+    RCU_REQUEST_APPLIED,
+    RCU_REQUEST_EMPTY
+};
+
+static void rcu_combine(rcu_t *rcu)
+{
+    // take every request published so far, they come off the stack newest first so reverse them into arrival order
+    struct rcu_request *batch = NULL;
+    struct rcu_request *req = atomic_exchange_explicit(&(rcu->requests), NULL, memory_order_acquire);
+    while (req)
+    {
+        struct rcu_request *temp = req->next;
+        req->next = batch;
+        batch = req;
+        req = temp;
+    }
+
+    if (!batch)
+        return;
+
+    // one copy and one node for the whole batch, redone only if a plain update slips in ahead of us
+    rcunode_t *neo = malloc(sizeof(rcunode_t));
+    rcunode_t *cur;
+    int status = RCU_REQUEST_APPLIED;
+
+    unsigned int guard = atm_reclaim_enter(1);
+    while (1)
+    {
+        cur = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(rcu->data));
+        if (!cur)
+        {
+            status = RCU_REQUEST_EMPTY;
+            break;
+        }
+
+        void *copy = rcu->cpy(cur->data_ptr);
+        for (req = batch; req; req = req->next)
+            req->mutate(copy, req->ctx);
+        rcunode_init(neo, copy);
+        neo->version = cur->version + 1;
+
+        if (atomic_compare_exchange_strong_explicit(&(rcu->data), &cur, neo, memory_order_release, memory_order_relaxed))
+            break;
+
+        free(copy);
+        ATM_STAT_ADD(rcu->stats, ATM_STAT_CAS_RETRIES, 1);
+    }
+    atm_reclaim_exit(guard, 1);
+
+    if (status == RCU_REQUEST_EMPTY)
+        free(neo);
+
+    // read each link before releasing its owner, a released request may vanish with its caller's stack
+    for (req = batch; req; )
+    {
+        struct rcu_request *temp = req->next;
+        atomic_store_explicit(&(req->status), status, memory_order_release);
+        req = temp;
+    }
+
+    if (status == RCU_REQUEST_APPLIED)
+    {
+        rcu_push(rcu, cur);
+        rcu_maybe_reclaim(rcu);
+    }
+}
+
+bool rcu_update_combined(rcu_t *rcu, void (*mutate)(void*, void*), void *ctx)
+{
+    // publish the request, whichever thread is combining applies it along with everyone else's
+    struct rcu_request req = { .mutate=mutate, .ctx=ctx, .next=NULL, .status=RCU_REQUEST_PENDING };
+    struct rcu_request *head = atomic_load_explicit(&(rcu->requests), memory_order_relaxed);
+    req.next = head;
+    while (!atomic_compare_exchange_weak_explicit(&(rcu->requests), &head, &req, memory_order_release, memory_order_relaxed))
+        req.next = head;
+
+    unsigned int spins = 0;
+    int status;
+    while ((status = atomic_load_explicit(&(req.status), memory_order_acquire)) == RCU_REQUEST_PENDING)
+    {
+        // nobody is combining, take the role and keep going until our own request has been served
+        bool expected = false;
+        if (!atomic_load_explicit(&(rcu->combining), memory_order_relaxed) &&
+            atomic_compare_exchange_strong_explicit(&(rcu->combining), &expected, true, memory_order_acquire, memory_order_relaxed))
+        {
+            while (atomic_load_explicit(&(req.status), memory_order_acquire) == RCU_REQUEST_PENDING)
+                rcu_combine(rcu);
+            atomic_store_explicit(&(rcu->combining), false, memory_order_release);
+            continue;
+        }
+
+        if (++spins >= RCU_COMBINE_SPINS)
+        {
+            spins = 0;
+            sched_yield();
+        }
+    }
+
+    return status == RCU_REQUEST_APPLIED;
 }
 
 void rcu_push(rcu_t *rcu, rcunode_t *node)
 {
-    struct rcu_stack_node *neo = malloc(sizeof(struct rcu_stack_node));
-    rcu_stack_node_init(neo, node);
+    // tag the node with the epoch it was unlinked in, under epochs it can be freed once the epoch has moved on twice
+    node->retire_epoch = atm_reclaim_tag();
+
+    // chain the retired node through its own next field, no bookkeeping allocation required
+    rcunode_t *cur = atomic_load_explicit(&(rcu->retired), memory_order_relaxed);
+    node->next = cur;
+
+    while (!atomic_compare_exchange_weak_explicit(&(rcu->retired), &cur, node, memory_order_release, memory_order_relaxed))
+    {
+        node->next = cur;
+        ATM_STAT_ADD(rcu->stats, ATM_STAT_CAS_RETRIES, 1);
+    }
+    ATM_STAT_ADD(rcu->stats, ATM_STAT_RETIRED, 1);
+}
+
+void rcu_reclaim(rcu_t *rcu)
+{
+    // take the whole retired stack, nodes that aren't safe yet get pushed back
+    rcunode_t *node = atomic_exchange_explicit(&(rcu->retired), NULL, memory_order_acquire);
+    struct reclaim_scan scan;
+    atm_reclaim_scan_begin(&scan);
 
-    struct rcu_stack_node *cur = atomic_load_explicit(&(rcu->cur_epoch_stack), memory_order_relaxed);
-    neo->next = cur;
+    rcunode_t *keep_first = NULL;
+    rcunode_t *keep_last = NULL;
+    unsigned long nfreed = 0;
+
+    while (node)
+    {
+        rcunode_t *temp = node->next;
+        if (atm_reclaim_is_safe(&scan, node, node->retire_epoch))
+        {
+            node->next = NULL;
+            free_rcunode(node);
+            nfreed++;
+        }
+        else
+        {
+            node->next = keep_first;
+            if (!keep_last)
+                keep_last = node;
+            keep_first = node;
+        }
+        node = temp;
+    }
 
-    while (!atomic_compare_exchange_strong_explicit(&(rcu->cur_epoch_stack), &cur, neo, memory_order_relaxed, memory_order_relaxed))
-        neo->next = cur;
+    atm_reclaim_scan_end(&scan);
+
+    if (keep_first)
+    {
+        rcunode_t *cur = atomic_load_explicit(&(rcu->retired), memory_order_relaxed);
+        keep_last->next = cur;
+        while (!atomic_compare_exchange_weak_explicit(&(rcu->retired), &cur, keep_first, memory_order_release, memory_order_relaxed))
+            keep_last->next = cur;
+    }
+    ATM_STAT_ADD(rcu->stats, ATM_STAT_FREED, nfreed);
+}
+
+void rcu_stats(rcu_t *rcu, struct atm_stats *out)
+{
+#ifdef ATM_STATS
+    atm_stats_collect(rcu->stats, out);
+#else
+    *out = (struct atm_stats) { 0 };
+#endif
 }
 
 void free_rcu(rcu_t *rcu)
 {
-    struct rcu_stack_node *old_final_epoch_stack = atomic_exchange_explicit(&(rcu->final_epoch_stack), NULL, memory_order_relaxed);
-    free_rcu_stack_node(old_final_epoch_stack);
-    struct rcu_stack_node *old_cur_epoch_stack = atomic_exchange_explicit(&(rcu->cur_epoch_stack), NULL, memory_order_relaxed);
-    free_rcu_stack_node(old_cur_epoch_stack);
+    atm_reclaimer_cancel(&(rcu->deferred));
+    rcunode_t *old_retired = atomic_exchange_explicit(&(rcu->retired), NULL, memory_order_relaxed);
+    free_rcunode_stack(old_retired);
     rcunode_t *cur = atomic_exchange_explicit(&(rcu->data), NULL, memory_order_relaxed);
     if (cur)
         free_rcunode(cur);
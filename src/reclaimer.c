@@ -0,0 +1,255 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "reclaimer.h"
+#include "reclaim.h"
+
+enum {
+    DEFERRED_IDLE,
+    DEFERRED_QUEUED,
+    DEFERRED_RUNNING,
+    DEFERRED_RERUN,
+    DEFERRED_CANCELLED
+};
+
+// deferring only pushes onto this stack and moves the item's state, the lock below is for sleeping and waking
+static struct atm_deferred *_Atomic reclaimer_pending = NULL;
+
+// the lock guards the thread's lifecycle, waiters for a finished pass and the reclaimer's sleep
+static pthread_mutex_t reclaimer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaimer_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t reclaimer_done = PTHREAD_COND_INITIALIZER;
+static pthread_t reclaimer_thread;
+static bool reclaimer_stopping = false;
+
+// checked without the lock so collections pay a single load when no reclaimer is running
+static _Atomic bool reclaimer_active = false;
+// set while the reclaimer is about to wait, deferring threads only take the lock to wake it then
+static _Atomic bool reclaimer_sleeping = false;
+// deferrals between checking the reclaimer is active and pushing, stop waits them out before draining
+static _Atomic unsigned long reclaimer_deferring = 0;
+
+void atm_deferred_init(struct atm_deferred *work, void (*fn)(void *), void *arg)
+{
+    work->fn = fn;
+    work->arg = arg;
+    work->next = NULL;
+    atomic_store_explicit(&(work->state), DEFERRED_IDLE, memory_order_relaxed);
+}
+
+static void reclaimer_push(struct atm_deferred *work)
+{
+    struct atm_deferred *head = atomic_load_explicit(&reclaimer_pending, memory_order_relaxed);
+    do
+        work->next = head;
+    while (!atomic_compare_exchange_weak_explicit(&reclaimer_pending, &head, work, memory_order_seq_cst, memory_order_relaxed));
+
+    // pairs with the reclaimer setting reclaimer_sleeping before it checks the stack a last time
+    if (atomic_load_explicit(&reclaimer_sleeping, memory_order_seq_cst))
+    {
+        pthread_mutex_lock(&reclaimer_lock);
+        pthread_cond_signal(&reclaimer_work);
+        pthread_mutex_unlock(&reclaimer_lock);
+    }
+}
+
+static void reclaimer_finished(void)
+{
+    pthread_mutex_lock(&reclaimer_lock);
+    pthread_cond_broadcast(&reclaimer_done);
+    pthread_mutex_unlock(&reclaimer_lock);
+}
+
+static void reclaimer_run(struct atm_deferred *work)
+{
+    // a cancel may have claimed the item while it sat on the stack, the item can't be touched once idle
+    int state = DEFERRED_QUEUED;
+    if (!atomic_compare_exchange_strong_explicit(&(work->state), &state, DEFERRED_RUNNING, memory_order_acquire, memory_order_acquire))
+    {
+        atomic_store_explicit(&(work->state), DEFERRED_IDLE, memory_order_release);
+        reclaimer_finished();
+        return;
+    }
+
+#ifndef ATM_RECLAIM_HP
+    // the deferring thread already tried to advance, trying again here lets nodes retired just before become safe
+    atm_ebr_try_advance();
+#endif
+    work->fn(work->arg);
+
+    // deferred again while running, the pass may have missed nodes retired meanwhile so it goes round once more
+    // a cancel may drop the rerun at any point, so both moves are compare and swaps
+    state = DEFERRED_RUNNING;
+    while (!atomic_compare_exchange_weak_explicit(&(work->state), &state, DEFERRED_IDLE, memory_order_release, memory_order_relaxed))
+    {
+        if (state == DEFERRED_RERUN && atomic_compare_exchange_strong_explicit(&(work->state), &state, DEFERRED_QUEUED, memory_order_acquire, memory_order_relaxed))
+        {
+            reclaimer_push(work);
+            break;
+        }
+        state = DEFERRED_RUNNING;
+    }
+    reclaimer_finished();
+}
+
+static void *reclaimer_body(void *arg)
+{
+    while (1)
+    {
+        struct atm_deferred *batch = atomic_exchange_explicit(&reclaimer_pending, NULL, memory_order_acquire);
+        if (batch)
+        {
+            // the stack hands items back newest first, run them in the order they were deferred
+            struct atm_deferred *work = NULL;
+            while (batch)
+            {
+                struct atm_deferred *next = batch->next;
+                batch->next = work;
+                work = batch;
+                batch = next;
+            }
+            while (work)
+            {
+                struct atm_deferred *next = work->next;
+                reclaimer_run(work);
+                work = next;
+            }
+            continue;
+        }
+
+        // drain whatever is still queued before stopping, nothing deferred is ever dropped
+        pthread_mutex_lock(&reclaimer_lock);
+        atomic_store_explicit(&reclaimer_sleeping, true, memory_order_seq_cst);
+        while (!atomic_load_explicit(&reclaimer_pending, memory_order_seq_cst) && !reclaimer_stopping)
+            pthread_cond_wait(&reclaimer_work, &reclaimer_lock);
+        atomic_store_explicit(&reclaimer_sleeping, false, memory_order_relaxed);
+        bool stop = reclaimer_stopping && !atomic_load_explicit(&reclaimer_pending, memory_order_acquire);
+        pthread_mutex_unlock(&reclaimer_lock);
+
+        if (stop)
+            break;
+    }
+
+    return NULL;
+}
+
+bool atm_reclaimer_start(void)
+{
+    pthread_mutex_lock(&reclaimer_lock);
+    if (atomic_load_explicit(&reclaimer_active, memory_order_relaxed))
+    {
+        pthread_mutex_unlock(&reclaimer_lock);
+        return true;
+    }
+
+    reclaimer_stopping = false;
+    bool started = pthread_create(&reclaimer_thread, NULL, reclaimer_body, NULL) == 0;
+    atomic_store_explicit(&reclaimer_active, started, memory_order_seq_cst);
+    pthread_mutex_unlock(&reclaimer_lock);
+
+    return started;
+}
+
+void atm_reclaimer_stop(void)
+{
+    // stop accepting work first, collections go back to reclaiming inline straight away
+    pthread_mutex_lock(&reclaimer_lock);
+    if (!atomic_load_explicit(&reclaimer_active, memory_order_relaxed))
+    {
+        pthread_mutex_unlock(&reclaimer_lock);
+        return;
+    }
+    atomic_store_explicit(&reclaimer_active, false, memory_order_seq_cst);
+    pthread_mutex_unlock(&reclaimer_lock);
+
+    // a deferral that saw the reclaimer active is still pushing, wait for it so the drain sees its item
+    while (atomic_load_explicit(&reclaimer_deferring, memory_order_seq_cst))
+        sched_yield();
+
+    pthread_mutex_lock(&reclaimer_lock);
+    reclaimer_stopping = true;
+    pthread_cond_signal(&reclaimer_work);
+    pthread_mutex_unlock(&reclaimer_lock);
+
+    pthread_join(reclaimer_thread, NULL);
+}
+
+bool atm_reclaimer_running(void)
+{
+    return atomic_load_explicit(&reclaimer_active, memory_order_relaxed);
+}
+
+bool atm_reclaimer_defer(struct atm_deferred *work)
+{
+    if (!atomic_load_explicit(&reclaimer_active, memory_order_relaxed))
+        return false;
+
+    // a queued pass hasn't taken the retired stack yet and a running one gets run once more, only an idle
+    // item needs pushing. Every move pairs with the reclaimer's acquire, so the pass sees what we retired
+    int state = atomic_load_explicit(&(work->state), memory_order_relaxed);
+    bool announced = false;
+    while (1)
+    {
+        if (state == DEFERRED_IDLE)
+        {
+            // announce the push before checking again, stop either waits for us or we see it stopping
+            if (!announced)
+            {
+                announced = true;
+                atomic_fetch_add_explicit(&reclaimer_deferring, 1, memory_order_seq_cst);
+                if (!atomic_load_explicit(&reclaimer_active, memory_order_seq_cst))
+                {
+                    atomic_fetch_sub_explicit(&reclaimer_deferring, 1, memory_order_release);
+                    return false;
+                }
+                state = atomic_load_explicit(&(work->state), memory_order_relaxed);
+                continue;
+            }
+            if (atomic_compare_exchange_weak_explicit(&(work->state), &state, DEFERRED_QUEUED, memory_order_acq_rel, memory_order_relaxed))
+            {
+                reclaimer_push(work);
+                break;
+            }
+        }
+        else if (state == DEFERRED_CANCELLED)
+            break;
+        else if (atomic_compare_exchange_weak_explicit(&(work->state), &state, state == DEFERRED_RUNNING ? DEFERRED_RERUN : state, memory_order_acq_rel, memory_order_relaxed))
+            break;
+    }
+
+    if (announced)
+        atomic_fetch_sub_explicit(&reclaimer_deferring, 1, memory_order_release);
+    return true;
+}
+
+static void reclaimer_wait_idle(struct atm_deferred *work)
+{
+    pthread_mutex_lock(&reclaimer_lock);
+    while (atomic_load_explicit(&(work->state), memory_order_acquire) != DEFERRED_IDLE)
+        pthread_cond_wait(&reclaimer_done, &reclaimer_lock);
+    pthread_mutex_unlock(&reclaimer_lock);
+}
+
+void atm_reclaimer_cancel(struct atm_deferred *work)
+{
+    // a pass that hasn't started is skipped and a pending rerun dropped, the stack is only unlinked by the reclaimer
+    int state = atomic_load_explicit(&(work->state), memory_order_relaxed);
+    while (state == DEFERRED_QUEUED || state == DEFERRED_RERUN)
+    {
+        int next = state == DEFERRED_QUEUED ? DEFERRED_CANCELLED : DEFERRED_RUNNING;
+        if (atomic_compare_exchange_weak_explicit(&(work->state), &state, next, memory_order_relaxed, memory_order_relaxed))
+            break;
+    }
+
+    // the reclaimer still holds the item until it goes back to idle, then the collection can go away
+    reclaimer_wait_idle(work);
+}
+
+void atm_reclaimer_flush(struct atm_deferred *work)
+{
+    // queued, running or rerun passes all finish before the item goes back to idle
+    reclaimer_wait_idle(work);
+}
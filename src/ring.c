@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "ring.h"
+
+void atm_ring_init(atm_ring *r, size_t capacity)
+{
+    // round capacity up to a power of two so positions can be masked into slot indices
+    size_t cap = 2;
+    while (cap < capacity)
+        cap <<= 1;
+
+    r->slots = malloc(cap * sizeof(struct ring_slot));
+    r->mask = cap - 1;
+
+    // each slot starts out expecting the enqueue at its own position
+    for (size_t i = 0; i < cap; i++)
+    {
+        atomic_store_explicit(&(r->slots[i].seq), i, memory_order_relaxed);
+        r->slots[i].data = NULL;
+    }
+
+    atomic_store_explicit(&(r->head), 0, memory_order_relaxed);
+    atomic_store_explicit(&(r->tail), 0, memory_order_relaxed);
+}
+
+size_t atm_ring_capacity(atm_ring *r)
+{
+    return r->mask + 1;
+}
+
+bool atm_ring_try_enqueue(atm_ring *r, void *data)
+{
+    size_t pos = atomic_load_explicit(&(r->tail), memory_order_relaxed);
+
+    while (1)
+    {
+        struct ring_slot *slot = &(r->slots[pos & r->mask]);
+        size_t seq = atomic_load_explicit(&(slot->seq), memory_order_acquire);
+        long diff = (long)seq - (long)pos;
+
+        if (diff == 0)
+        {
+            // slot is free for this lap, try to claim the position
+            if (atomic_compare_exchange_weak_explicit(&(r->tail), &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                slot->data = data;
+                // publish the data, consumers wait for seq == pos + 1
+                atomic_store_explicit(&(slot->seq), pos + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            // slot still holds an item from the previous lap, the ring is full
+            return false;
+        }
+        else
+        {
+            // another producer claimed this position, catch up
+            pos = atomic_load_explicit(&(r->tail), memory_order_relaxed);
+        }
+    }
+}
+
+void *atm_ring_try_dequeue(atm_ring *r)
+{
+    size_t pos = atomic_load_explicit(&(r->head), memory_order_relaxed);
+
+    while (1)
+    {
+        struct ring_slot *slot = &(r->slots[pos & r->mask]);
+        size_t seq = atomic_load_explicit(&(slot->seq), memory_order_acquire);
+        long diff = (long)seq - (long)(pos + 1);
+
+        if (diff == 0)
+        {
+            // slot holds published data for this position, try to claim it
+            if (atomic_compare_exchange_weak_explicit(&(r->head), &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                void *res = slot->data;
+                slot->data = NULL;
+                // hand the slot back to producers for the next lap
+                atomic_store_explicit(&(slot->seq), pos + r->mask + 1, memory_order_release);
+                return res;
+            }
+        }
+        else if (diff < 0)
+        {
+            // nothing has been published at this position yet, the ring is empty
+            return NULL;
+        }
+        else
+        {
+            // another consumer claimed this position, catch up
+            pos = atomic_load_explicit(&(r->head), memory_order_relaxed);
+        }
+    }
+}
+
+void free_atm_ring(atm_ring *r)
+{
+    free_atm_ring_auto(r);
+    free(r);
+}
+
+void free_atm_ring_auto(atm_ring *r)
+{
+    // free any data still held by the ring
+    void *data;
+    while ((data = atm_ring_try_dequeue(r)))
+        free(data);
+
+    free(r->slots);
+    r->slots = NULL;
+}
@@ -0,0 +1,127 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "seqlock.h"
+
+static void atm_seqlock_backoff(unsigned int *spins)
+{
+    // a writer that has been preempted mid update can hold everyone up, give it the cpu back
+    if (++(*spins) >= ATM_SEQLOCK_SPINS)
+    {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+static void atm_seqlock_store(atm_seqlock *s, const void *value)
+{
+    // the last word may only be partly covered by the value, the rest of it stays zero
+    const unsigned char *src = value;
+    for (size_t i = 0, off = 0; off < s->size; i++, off += sizeof(unsigned long))
+    {
+        unsigned long word = 0;
+        size_t n = s->size - off < sizeof(unsigned long) ? s->size - off : sizeof(unsigned long);
+        memcpy(&word, src + off, n);
+        atomic_store_explicit(&(s->words[i]), word, memory_order_relaxed);
+    }
+}
+
+bool atm_seqlock_init(atm_seqlock *s, size_t size, const void *value)
+{
+    if (size > ATM_SEQLOCK_SIZE)
+        return false;
+
+    s->size = size;
+    for (size_t i = 0; i < ATM_SEQLOCK_WORDS; i++)
+        atomic_store_explicit(&(s->words[i]), 0, memory_order_relaxed);
+
+    // like rcu_init, starting without a value reads back as version 0 and zeroed data
+    if (value)
+        atm_seqlock_store(s, value);
+    atomic_store_explicit(&(s->seq), value ? 2 : 0, memory_order_release);
+
+    return true;
+}
+
+unsigned long atm_seqlock_read_versioned(atm_seqlock *s, void *out)
+{
+    unsigned char *dst = out;
+    unsigned int spins = 0;
+
+    while (1)
+    {
+        unsigned long begin = atomic_load_explicit(&(s->seq), memory_order_acquire);
+        if (begin & 1)
+        {
+            atm_seqlock_backoff(&spins);
+            continue;
+        }
+
+        for (size_t i = 0, off = 0; off < s->size; i++, off += sizeof(unsigned long))
+        {
+            unsigned long word = atomic_load_explicit(&(s->words[i]), memory_order_relaxed);
+            size_t n = s->size - off < sizeof(unsigned long) ? s->size - off : sizeof(unsigned long);
+            memcpy(dst + off, &word, n);
+        }
+
+        // keeps the word loads above from moving past the second read of the counter
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&(s->seq), memory_order_relaxed) == begin)
+            return begin >> 1;
+
+        atm_seqlock_backoff(&spins);
+    }
+}
+
+void atm_seqlock_read(atm_seqlock *s, void *out)
+{
+    atm_seqlock_read_versioned(s, out);
+}
+
+unsigned long atm_seqlock_version(atm_seqlock *s)
+{
+    // a write in progress hasn't published its version yet
+    return atomic_load_explicit(&(s->seq), memory_order_acquire) >> 1;
+}
+
+static bool atm_seqlock_write(atm_seqlock *s, const void *value, bool conditional, unsigned long expected_version)
+{
+    unsigned int spins = 0;
+    unsigned long seq = atomic_load_explicit(&(s->seq), memory_order_relaxed);
+
+    while (1)
+    {
+        if (conditional && (seq >> 1) != expected_version)
+            return false;
+
+        // writers serialise by moving the counter from even to odd, acquiring the previous writer's words
+        if (!(seq & 1) && atomic_compare_exchange_weak_explicit(&(s->seq), &seq, seq + 1, memory_order_acquire, memory_order_relaxed))
+            break;
+
+        if (seq & 1)
+        {
+            atm_seqlock_backoff(&spins);
+            seq = atomic_load_explicit(&(s->seq), memory_order_relaxed);
+        }
+    }
+
+    // orders the odd counter before any of the word stores, a reader that sees a new word sees the odd counter
+    atomic_thread_fence(memory_order_release);
+    atm_seqlock_store(s, value);
+    atomic_store_explicit(&(s->seq), seq + 2, memory_order_release);
+
+    return true;
+}
+
+void atm_seqlock_update(atm_seqlock *s, const void *value)
+{
+    atm_seqlock_write(s, value, false, 0);
+}
+
+bool atm_seqlock_update_if(atm_seqlock *s, const void *value, unsigned long expected_version)
+{
+    return atm_seqlock_write(s, value, true, expected_version);
+}
@@ -0,0 +1,219 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "shm_queue.h"
+
+// a lock based fallback would keep its lock in process private memory, links must be real atomics
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory links need lock free 64 bit atomics");
+
+#define SHM_QUEUE_MAGIC 0x61746d71u
+#define SHM_QUEUE_NIL UINT32_MAX
+
+// links pack a node index in the low half and a tag in the high half, every store through a link bumps
+// its tag so a CAS holding a stale view fails even when the same index has come back
+static inline uint64_t shm_link(uint32_t idx, uint32_t tag)
+{
+    return ((uint64_t)tag << 32) | idx;
+}
+
+static inline uint32_t shm_idx(uint64_t link)
+{
+    return (uint32_t)link;
+}
+
+static inline uint32_t shm_tag(uint64_t link)
+{
+    return (uint32_t)(link >> 32);
+}
+
+static inline struct shm_queue_node *shm_node(atm_shm_queue *q, uint32_t idx)
+{
+    return (struct shm_queue_node *)((char *)q + sizeof(atm_shm_queue) + (size_t)idx * q->node_size);
+}
+
+static size_t shm_node_size(size_t item_size)
+{
+    // whole words for the payload, rounded to a cache line so neighbouring nodes don't share one
+    size_t words = (item_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    size_t size = sizeof(struct shm_queue_node) + words * sizeof(uint64_t);
+    return (size + ATM_CACHE_LINE - 1) / ATM_CACHE_LINE * ATM_CACHE_LINE;
+}
+
+size_t atm_shm_queue_region_size(size_t capacity, size_t item_size)
+{
+    // one extra node is always the queue's dummy
+    return sizeof(atm_shm_queue) + (capacity + 1) * shm_node_size(item_size);
+}
+
+bool atm_shm_queue_init(atm_shm_queue *q, size_t region_size, size_t item_size)
+{
+    size_t node_size = shm_node_size(item_size);
+    if (region_size < sizeof(atm_shm_queue) + 2 * node_size)
+        return false;
+
+    size_t nodes = (region_size - sizeof(atm_shm_queue)) / node_size;
+    if (nodes >= SHM_QUEUE_NIL)
+        nodes = SHM_QUEUE_NIL - 1;
+
+    atomic_store_explicit(&(q->magic), 0, memory_order_relaxed);
+    q->nodes = nodes;
+    q->node_size = node_size;
+    q->item_size = item_size;
+
+    // node 0 starts as the dummy, the rest are chained onto the free list in order
+    atomic_store_explicit(&(shm_node(q, 0)->next), shm_link(SHM_QUEUE_NIL, 0), memory_order_relaxed);
+    for (uint32_t i = 1; i < nodes; i++)
+        atomic_store_explicit(&(shm_node(q, i)->next), shm_link(i + 1 < nodes ? i + 1 : SHM_QUEUE_NIL, 0), memory_order_relaxed);
+
+    atomic_store_explicit(&(q->head), shm_link(0, 0), memory_order_relaxed);
+    atomic_store_explicit(&(q->tail), shm_link(0, 0), memory_order_relaxed);
+    atomic_store_explicit(&(q->free_nodes), shm_link(1, 0), memory_order_relaxed);
+
+    // publish the layout to any process attaching
+    atomic_store_explicit(&(q->magic), SHM_QUEUE_MAGIC, memory_order_release);
+    return true;
+}
+
+bool atm_shm_queue_attach(atm_shm_queue *q, size_t region_size, size_t item_size)
+{
+    // the region has to be initialised, for the same item size, and fully mapped by this process
+    if (atomic_load_explicit(&(q->magic), memory_order_acquire) != SHM_QUEUE_MAGIC)
+        return false;
+    if (q->item_size != item_size || q->node_size != shm_node_size(item_size))
+        return false;
+    return region_size >= sizeof(atm_shm_queue) + (size_t)q->nodes * q->node_size;
+}
+
+size_t atm_shm_queue_capacity(atm_shm_queue *q)
+{
+    return q->nodes - 1;
+}
+
+static uint32_t shm_queue_alloc_node(atm_shm_queue *q)
+{
+    uint64_t top = atomic_load_explicit(&(q->free_nodes), memory_order_acquire);
+    while (shm_idx(top) != SHM_QUEUE_NIL)
+    {
+        // the node may be popped and reused under us, the read is still a valid link and the tag on top fails the CAS
+        uint64_t next = atomic_load_explicit(&(shm_node(q, shm_idx(top))->next), memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&(q->free_nodes), &top, shm_link(shm_idx(next), shm_tag(top) + 1),
+                                                  memory_order_acquire, memory_order_acquire))
+            return shm_idx(top);
+    }
+    return SHM_QUEUE_NIL;
+}
+
+static void shm_queue_release_node(atm_shm_queue *q, uint32_t idx)
+{
+    struct shm_queue_node *node = shm_node(q, idx);
+    uint64_t top = atomic_load_explicit(&(q->free_nodes), memory_order_relaxed);
+    while (1)
+    {
+        uint64_t link = atomic_load_explicit(&(node->next), memory_order_relaxed);
+        atomic_store_explicit(&(node->next), shm_link(shm_idx(top), shm_tag(link) + 1), memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&(q->free_nodes), &top, shm_link(idx, shm_tag(top) + 1),
+                                                  memory_order_release, memory_order_relaxed))
+            return;
+    }
+}
+
+bool atm_shm_queue_try_enqueue(atm_shm_queue *q, const void *item)
+{
+    // an empty pool means the queue is full
+    uint32_t idx = shm_queue_alloc_node(q);
+    if (idx == SHM_QUEUE_NIL)
+        return false;
+
+    struct shm_queue_node *node = shm_node(q, idx);
+    size_t words = (q->item_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    for (size_t i = 0; i < words; i++)
+    {
+        uint64_t w = 0;
+        size_t n = q->item_size - i * sizeof(uint64_t);
+        memcpy(&w, (const char *)item + i * sizeof(uint64_t), n < sizeof(uint64_t) ? n : sizeof(uint64_t));
+        atomic_store_explicit(&(node->words[i]), w, memory_order_relaxed);
+    }
+    uint64_t link = atomic_load_explicit(&(node->next), memory_order_relaxed);
+    atomic_store_explicit(&(node->next), shm_link(SHM_QUEUE_NIL, shm_tag(link) + 1), memory_order_relaxed);
+
+    uint64_t tail;
+    while (1)
+    {
+        tail = atomic_load_explicit(&(q->tail), memory_order_acquire);
+        struct shm_queue_node *last = shm_node(q, shm_idx(tail));
+        uint64_t next = atomic_load_explicit(&(last->next), memory_order_acquire);
+
+        if (tail != atomic_load_explicit(&(q->tail), memory_order_acquire))
+            continue;
+
+        if (shm_idx(next) == SHM_QUEUE_NIL)
+        {
+            // link the node, the release publishes its payload to whoever dequeues it
+            if (atomic_compare_exchange_weak_explicit(&(last->next), &next, shm_link(idx, shm_tag(next) + 1),
+                                                      memory_order_release, memory_order_relaxed))
+                break;
+        }
+        else
+        {
+            // tail is lagging, help it along
+            atomic_compare_exchange_weak_explicit(&(q->tail), &tail, shm_link(shm_idx(next), shm_tag(tail) + 1),
+                                                  memory_order_release, memory_order_relaxed);
+        }
+    }
+
+    atomic_compare_exchange_strong_explicit(&(q->tail), &tail, shm_link(idx, shm_tag(tail) + 1),
+                                            memory_order_release, memory_order_relaxed);
+    return true;
+}
+
+bool atm_shm_queue_try_dequeue(atm_shm_queue *q, void *out)
+{
+    size_t words = (q->item_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    uint64_t head;
+    while (1)
+    {
+        head = atomic_load_explicit(&(q->head), memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&(q->tail), memory_order_acquire);
+        uint64_t next = atomic_load_explicit(&(shm_node(q, shm_idx(head))->next), memory_order_acquire);
+
+        if (head != atomic_load_explicit(&(q->head), memory_order_acquire))
+            continue;
+
+        if (shm_idx(head) == shm_idx(tail))
+        {
+            if (shm_idx(next) == SHM_QUEUE_NIL)
+                return false;
+
+            // tail is lagging, help it along
+            atomic_compare_exchange_weak_explicit(&(q->tail), &tail, shm_link(shm_idx(next), shm_tag(tail) + 1),
+                                                  memory_order_release, memory_order_relaxed);
+            continue;
+        }
+
+        // a stale view can still read NIL here, just look again
+        if (shm_idx(next) == SHM_QUEUE_NIL)
+            continue;
+
+        // copy out before swinging head, once it moves the node can be recycled. If it was recycled while
+        // copying the CAS below fails and the copy is thrown away
+        struct shm_queue_node *node = shm_node(q, shm_idx(next));
+        for (size_t i = 0; i < words; i++)
+        {
+            uint64_t w = atomic_load_explicit(&(node->words[i]), memory_order_relaxed);
+            size_t n = q->item_size - i * sizeof(uint64_t);
+            memcpy((char *)out + i * sizeof(uint64_t), &w, n < sizeof(uint64_t) ? n : sizeof(uint64_t));
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&(q->head), &head, shm_link(shm_idx(next), shm_tag(head) + 1),
+                                                  memory_order_acq_rel, memory_order_relaxed))
+            break;
+    }
+
+    // the old dummy goes back to the pool, the dequeued node is the new dummy
+    shm_queue_release_node(q, shm_idx(head));
+    return true;
+}
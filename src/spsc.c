@@ -0,0 +1,124 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "spsc.h"
+
+void atm_spsc_init(atm_spsc *q, size_t capacity)
+{
+    // round capacity up to a power of two so positions can be masked into slot indices
+    size_t cap = 2;
+    while (cap < capacity)
+        cap <<= 1;
+
+    q->slots = calloc(cap, sizeof(void*));
+    q->mask = cap - 1;
+    atomic_store_explicit(&(q->head), 0, memory_order_relaxed);
+    atomic_store_explicit(&(q->tail), 0, memory_order_relaxed);
+    q->cached_head = 0;
+    q->cached_tail = 0;
+}
+
+size_t atm_spsc_capacity(atm_spsc *q)
+{
+    return q->mask + 1;
+}
+
+// producer side, only ever called from the single producer thread
+static size_t atm_spsc_free_slots(atm_spsc *q, size_t tail, size_t want)
+{
+    size_t cap = q->mask + 1;
+    size_t avail = cap - (tail - q->cached_head);
+    if (avail < want)
+    {
+        // only touch the consumers cache line when our cached view says we are full
+        q->cached_head = atomic_load_explicit(&(q->head), memory_order_acquire);
+        avail = cap - (tail - q->cached_head);
+    }
+    return avail;
+}
+
+// consumer side, only ever called from the single consumer thread
+static size_t atm_spsc_used_slots(atm_spsc *q, size_t head, size_t want)
+{
+    size_t avail = q->cached_tail - head;
+    if (avail < want)
+    {
+        // only touch the producers cache line when our cached view says we are empty
+        q->cached_tail = atomic_load_explicit(&(q->tail), memory_order_acquire);
+        avail = q->cached_tail - head;
+    }
+    return avail;
+}
+
+bool atm_spsc_try_enqueue(atm_spsc *q, void *data)
+{
+    size_t tail = atomic_load_explicit(&(q->tail), memory_order_relaxed);
+    if (atm_spsc_free_slots(q, tail, 1) == 0)
+        return false;
+
+    q->slots[tail & q->mask] = data;
+    atomic_store_explicit(&(q->tail), tail + 1, memory_order_release);
+    return true;
+}
+
+void *atm_spsc_try_dequeue(atm_spsc *q)
+{
+    size_t head = atomic_load_explicit(&(q->head), memory_order_relaxed);
+    if (atm_spsc_used_slots(q, head, 1) == 0)
+        return NULL;
+
+    void *res = q->slots[head & q->mask];
+    atomic_store_explicit(&(q->head), head + 1, memory_order_release);
+    return res;
+}
+
+size_t atm_spsc_enqueue_bulk(atm_spsc *q, void **items, size_t n)
+{
+    size_t tail = atomic_load_explicit(&(q->tail), memory_order_relaxed);
+    size_t avail = atm_spsc_free_slots(q, tail, n);
+    if (n > avail)
+        n = avail;
+
+    // write every slot first and publish them all with one release store
+    for (size_t i = 0; i < n; i++)
+        q->slots[(tail + i) & q->mask] = items[i];
+
+    if (n)
+        atomic_store_explicit(&(q->tail), tail + n, memory_order_release);
+    return n;
+}
+
+size_t atm_spsc_dequeue_bulk(atm_spsc *q, void **out, size_t max)
+{
+    size_t head = atomic_load_explicit(&(q->head), memory_order_relaxed);
+    size_t avail = atm_spsc_used_slots(q, head, max);
+    if (max > avail)
+        max = avail;
+
+    // read every slot first and hand them all back with one release store
+    for (size_t i = 0; i < max; i++)
+        out[i] = q->slots[(head + i) & q->mask];
+
+    if (max)
+        atomic_store_explicit(&(q->head), head + max, memory_order_release);
+    return max;
+}
+
+void free_atm_spsc(atm_spsc *q)
+{
+    free_atm_spsc_auto(q);
+    free(q);
+}
+
+void free_atm_spsc_auto(atm_spsc *q)
+{
+    // free any data still held by the queue
+    void *data;
+    while ((data = atm_spsc_try_dequeue(q)))
+        free(data);
+
+    free(q->slots);
+    q->slots = NULL;
+}
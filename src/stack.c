@@ -0,0 +1,286 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "stack.h"
+#include "reclaim.h"
+
+// every thread gets its own random stream for picking exchanger slots
+static _Atomic unsigned long stack_next_thread = 0;
+static _Thread_local uint64_t stack_rng = 0;
+
+static size_t stack_random_slot(void)
+{
+    if (!stack_rng)
+        stack_rng = (atomic_fetch_add_explicit(&stack_next_thread, 1, memory_order_relaxed) + 1) * 0x9E3779B97F4A7C15ULL;
+
+    // xorshift64, plenty for picking slots
+    stack_rng ^= stack_rng << 13;
+    stack_rng ^= stack_rng >> 7;
+    stack_rng ^= stack_rng << 17;
+    return stack_rng % ATM_STACK_ELIMINATION_SLOTS;
+}
+
+static void free_stack_node_list(struct stack_node *node)
+{
+    // frees a chain of nodes linked through free_next, as found on the pool and retired stack
+    while (node)
+    {
+        struct stack_node *temp = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        if (node->data)
+            free(node->data);
+        free(node);
+        node = temp;
+    }
+}
+
+static void atm_stack_reclaim_deferred(void *arg)
+{
+    atm_stack_reclaim((atm_stack *)arg);
+}
+
+void atm_stack_init(atm_stack *s)
+{
+    atomic_store_explicit(&(s->top), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(s->retired), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(s->free_nodes), NULL, memory_order_relaxed);
+    for (int i = 0; i < ATM_STACK_ELIMINATION_SLOTS; i++)
+        atomic_store_explicit(&(s->elimination[i].item), NULL, memory_order_relaxed);
+    s->elimination_spins = ATM_STACK_ELIMINATION_SPINS;
+    s->eliminate_first = false;
+    atm_deferred_init(&(s->deferred), atm_stack_reclaim_deferred, s);
+#ifdef ATM_STATS
+    atm_stats_init(s->stats);
+#endif
+}
+
+static struct stack_node *atm_stack_alloc_node(atm_stack *s, void *data)
+{
+    // the top of the pool stays protected while we read its link, a popped node can't
+    // re-enter the pool while another thread still protects it, so the pop is safe from ABA
+    unsigned int guard = atm_reclaim_enter(1);
+    struct stack_node *node;
+    while ((node = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(s->free_nodes))))
+    {
+        struct stack_node *next = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        struct stack_node *expected = node;
+        if (atomic_compare_exchange_weak_explicit(&(s->free_nodes), &expected, next, memory_order_acquire, memory_order_relaxed))
+            break;
+        ATM_STAT_ADD(s->stats, ATM_STAT_CAS_RETRIES, 1);
+    }
+    atm_reclaim_exit(guard, 1);
+
+    // pool is empty, fall back to the heap
+    if (!node)
+        node = malloc(sizeof(struct stack_node));
+
+    node->data = data;
+    atomic_store_explicit(&(node->next), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(node->free_next), NULL, memory_order_relaxed);
+    node->retire_epoch = 0;
+    return node;
+}
+
+static void atm_stack_push_list(atm_stack *s, struct stack_node *_Atomic *stack, struct stack_node *first, struct stack_node *last)
+{
+    // push the chain first -> ... -> last onto the pool or retired stack, nodes are linked through free_next
+    struct stack_node *cur = atomic_load_explicit(stack, memory_order_relaxed);
+    atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+
+    while (!atomic_compare_exchange_weak_explicit(stack, &cur, first, memory_order_release, memory_order_relaxed))
+        atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+}
+
+static void atm_stack_retire(atm_stack *s, struct stack_node *node)
+{
+    // tag the node with the epoch it was unlinked in, under epochs it can be recycled once the epoch has moved on twice
+    node->data = NULL;
+    node->retire_epoch = atm_reclaim_tag();
+    atm_stack_push_list(s, &(s->retired), node, node);
+    ATM_STAT_ADD(s->stats, ATM_STAT_RETIRED, 1);
+
+    // once this thread has retired enough nodes, recycle whatever is no longer reachable,
+    // handing the pass to the background reclaimer when one is running
+    if (atm_reclaim_tick(1) && !atm_reclaimer_defer(&(s->deferred)))
+        atm_stack_reclaim(s);
+}
+
+static bool atm_stack_offer(atm_stack *s, void *data)
+{
+    // park the item in a free slot and give a pop a while to take it
+    struct stack_exchanger *slot = &(s->elimination[stack_random_slot()]);
+    void *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&(slot->item), &expected, data, memory_order_release, memory_order_relaxed))
+        return false;
+
+    for (unsigned int i = 0; i < s->elimination_spins; i++)
+        if (atomic_load_explicit(&(slot->item), memory_order_relaxed) != data)
+            return true;
+
+    // withdraw the offer, failing means a pop took the item in the meantime
+    expected = data;
+    return !atomic_compare_exchange_strong_explicit(&(slot->item), &expected, NULL, memory_order_relaxed, memory_order_relaxed);
+}
+
+static void *atm_stack_take(atm_stack *s)
+{
+    // look for a push waiting in a random slot, pops never wait themselves
+    struct stack_exchanger *slot = &(s->elimination[stack_random_slot()]);
+    void *data = atomic_load_explicit(&(slot->item), memory_order_relaxed);
+    if (data && atomic_compare_exchange_strong_explicit(&(slot->item), &data, NULL, memory_order_acquire, memory_order_relaxed))
+        return data;
+    return NULL;
+}
+
+void atm_stack_push(atm_stack *s, void *data)
+{
+    struct stack_node *node = atm_stack_alloc_node(s, data);
+    struct stack_node *cur = atomic_load_explicit(&(s->top), memory_order_relaxed);
+    bool offer = s->eliminate_first;
+
+    while (1)
+    {
+        // lost the race on top, try to hand the item straight to a pop instead
+        if (offer && atm_stack_offer(s, data))
+        {
+            ATM_STAT_ADD(s->stats, ATM_STAT_ELIMINATIONS, 1);
+            // another thread may be protecting this node as the top of the pool, so it goes back through retirement
+            atm_stack_retire(s, node);
+            return;
+        }
+        offer = true;
+
+        // top is never dereferenced here, so pushing needs no protection
+        atomic_store_explicit(&(node->next), cur, memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&(s->top), &cur, node, memory_order_release, memory_order_relaxed))
+            return;
+        ATM_STAT_ADD(s->stats, ATM_STAT_CAS_RETRIES, 1);
+        cur = atomic_load_explicit(&(s->top), memory_order_relaxed);
+    }
+}
+
+void *atm_stack_pop(atm_stack *s)
+{
+    if (s->eliminate_first)
+    {
+        void *res = atm_stack_take(s);
+        if (res)
+        {
+            ATM_STAT_ADD(s->stats, ATM_STAT_ELIMINATIONS, 1);
+            return res;
+        }
+    }
+
+    // protects the top node while we read its link
+    unsigned int guard = atm_reclaim_enter(1);
+    struct stack_node *node;
+    void *res = NULL;
+
+    while ((node = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(s->top))))
+    {
+        struct stack_node *next = atomic_load_explicit(&(node->next), memory_order_relaxed);
+        struct stack_node *expected = node;
+        if (atomic_compare_exchange_weak_explicit(&(s->top), &expected, next, memory_order_acquire, memory_order_relaxed))
+        {
+            res = node->data;
+            break;
+        }
+        ATM_STAT_ADD(s->stats, ATM_STAT_CAS_RETRIES, 1);
+
+        // lost the race on top, a push that lost it too may be waiting to hand over its item
+        if ((res = atm_stack_take(s)))
+        {
+            ATM_STAT_ADD(s->stats, ATM_STAT_ELIMINATIONS, 1);
+            node = NULL;
+            break;
+        }
+    }
+    atm_reclaim_exit(guard, 1);
+
+    if (node)
+        atm_stack_retire(s, node);
+    else if (!res)
+        ATM_STAT_ADD(s->stats, ATM_STAT_EMPTY_DEQUEUES, 1);
+
+    return res;
+}
+
+void atm_stack_reclaim(atm_stack *s)
+{
+    // take the whole retired stack, nodes that aren't safe yet get pushed back
+    struct stack_node *node = atomic_exchange_explicit(&(s->retired), NULL, memory_order_acquire);
+    struct reclaim_scan scan;
+    atm_reclaim_scan_begin(&scan);
+
+    struct stack_node *safe_first = NULL;
+    struct stack_node *safe_last = NULL;
+    struct stack_node *keep_first = NULL;
+    struct stack_node *keep_last = NULL;
+    unsigned long nfreed = 0;
+
+    while (node)
+    {
+        struct stack_node *temp = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        if (atm_reclaim_is_safe(&scan, node, node->retire_epoch))
+        {
+            nfreed++;
+            atomic_store_explicit(&(node->free_next), safe_first, memory_order_relaxed);
+            if (!safe_last)
+                safe_last = node;
+            safe_first = node;
+        }
+        else
+        {
+            atomic_store_explicit(&(node->free_next), keep_first, memory_order_relaxed);
+            if (!keep_last)
+                keep_last = node;
+            keep_first = node;
+        }
+        node = temp;
+    }
+
+    atm_reclaim_scan_end(&scan);
+
+    if (keep_first)
+        atm_stack_push_list(s, &(s->retired), keep_first, keep_last);
+
+    // no thread can still see these nodes, return them to the pool
+    if (safe_first)
+        atm_stack_push_list(s, &(s->free_nodes), safe_first, safe_last);
+    ATM_STAT_ADD(s->stats, ATM_STAT_FREED, nfreed);
+}
+
+void atm_stack_stats(atm_stack *s, struct atm_stats *out)
+{
+#ifdef ATM_STATS
+    atm_stats_collect(s->stats, out);
+#else
+    *out = (struct atm_stats) { 0 };
+#endif
+}
+
+void free_atm_stack(atm_stack *s)
+{
+    free_atm_stack_auto(s);
+    free(s);
+}
+
+void free_atm_stack_auto(atm_stack *s)
+{
+    atm_reclaimer_cancel(&(s->deferred));
+    free_stack_node_list(atomic_exchange_explicit(&(s->retired), NULL, memory_order_relaxed));
+    free_stack_node_list(atomic_exchange_explicit(&(s->free_nodes), NULL, memory_order_relaxed));
+
+    // free any data still held by the stack
+    struct stack_node *cur = atomic_exchange_explicit(&(s->top), NULL, memory_order_relaxed);
+    while (cur)
+    {
+        struct stack_node *temp = atomic_load_explicit(&(cur->next), memory_order_relaxed);
+        if (cur->data)
+            free(cur->data);
+        free(cur);
+        cur = temp;
+    }
+}
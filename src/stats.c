@@ -0,0 +1,54 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "stats.h"
+#include "reclaim.h"
+
+// hands each thread the next stripe the first time it counts something
+static _Atomic unsigned int stats_next_stripe = 0;
+static _Thread_local unsigned int stats_stripe = 0;
+static _Thread_local bool stats_has_stripe = false;
+
+void atm_stats_init(struct atm_stats_stripe *stripes)
+{
+    for (int i = 0; i < ATM_STATS_STRIPES; i++)
+        for (int j = 0; j < ATM_STAT_COUNT; j++)
+            atomic_store_explicit(&(stripes[i].counters[j]), 0, memory_order_relaxed);
+}
+
+void atm_stats_add(struct atm_stats_stripe *stripes, enum atm_stat stat, unsigned long n)
+{
+    if (!stats_has_stripe)
+    {
+        stats_stripe = atomic_fetch_add_explicit(&stats_next_stripe, 1, memory_order_relaxed) % ATM_STATS_STRIPES;
+        stats_has_stripe = true;
+    }
+
+    // the stripe is almost always written by this thread alone, the atomic add only matters once threads share one
+    atomic_fetch_add_explicit(&(stripes[stats_stripe].counters[stat]), n, memory_order_relaxed);
+}
+
+void atm_stats_collect(struct atm_stats_stripe *stripes, struct atm_stats *out)
+{
+    unsigned long totals[ATM_STAT_COUNT] = { 0 };
+    for (int i = 0; i < ATM_STATS_STRIPES; i++)
+        for (int j = 0; j < ATM_STAT_COUNT; j++)
+            totals[j] += atomic_load_explicit(&(stripes[i].counters[j]), memory_order_relaxed);
+
+    out->cas_retries = totals[ATM_STAT_CAS_RETRIES];
+    out->empty_dequeues = totals[ATM_STAT_EMPTY_DEQUEUES];
+    out->retired = totals[ATM_STAT_RETIRED];
+    out->freed = totals[ATM_STAT_FREED];
+    out->eliminations = totals[ATM_STAT_ELIMINATIONS];
+
+    // stripes are read one after another, a node freed mid snapshot can show up without its retirement
+    out->backlog = out->retired > out->freed ? out->retired - out->freed : 0;
+
+#ifdef ATM_RECLAIM_HP
+    // hazard pointers have no epochs to advance
+    out->epoch_advances = 0;
+#else
+    // the epoch domain is shared by every collection and starts at zero, so its epoch is the number of advances
+    out->epoch_advances = atm_ebr_epoch();
+#endif
+}
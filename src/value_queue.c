@@ -0,0 +1,211 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "value_queue.h"
+#include "reclaim.h"
+
+static void atm_value_queue_reclaim_deferred(void *arg)
+{
+    atm_value_queue_reclaim((atm_value_queue *)arg);
+}
+
+void atm_value_queue_init(atm_value_queue *q, size_t size)
+{
+    // the sentinel never carries a value, but every node is the same size so any of them can be pooled
+    q->size = size;
+    struct value_node *init = malloc(sizeof(struct value_node) + size);
+    atomic_store_explicit(&(init->next), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(init->free_next), NULL, memory_order_relaxed);
+    init->retire_epoch = 0;
+    q->head = init;
+    q->tail = init;
+    q->retired = NULL;
+    q->free_nodes = NULL;
+    atm_deferred_init(&(q->deferred), atm_value_queue_reclaim_deferred, q);
+}
+
+static struct value_node *atm_value_queue_alloc_node(atm_value_queue *q)
+{
+    // same protected pop as the pointer queue's pool, a popped node can't come back while it is protected
+    unsigned int guard = atm_reclaim_enter(1);
+    struct value_node *node;
+    while ((node = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(q->free_nodes))))
+    {
+        struct value_node *next = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        struct value_node *expected = node;
+        if (atomic_compare_exchange_weak_explicit(&(q->free_nodes), &expected, next, memory_order_acquire, memory_order_relaxed))
+            break;
+    }
+    atm_reclaim_exit(guard, 1);
+
+    if (!node)
+        node = malloc(sizeof(struct value_node) + q->size);
+
+    atomic_store_explicit(&(node->next), NULL, memory_order_relaxed);
+    atomic_store_explicit(&(node->free_next), NULL, memory_order_relaxed);
+    node->retire_epoch = 0;
+    return node;
+}
+
+static void atm_value_queue_push(struct value_node *_Atomic *stack, struct value_node *first, struct value_node *last)
+{
+    // retired and pooled nodes are both chained through free_next
+    struct value_node *cur = atomic_load_explicit(stack, memory_order_relaxed);
+    atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+
+    while (!atomic_compare_exchange_weak_explicit(stack, &cur, first, memory_order_release, memory_order_relaxed))
+        atomic_store_explicit(&(last->free_next), cur, memory_order_relaxed);
+}
+
+void atm_value_queue_enqueue(atm_value_queue *q, const void *value)
+{
+    unsigned int guard = atm_reclaim_enter(1);
+
+    // the value is written before the node is published, it is never modified again until the node is recycled
+    struct value_node *neo = atm_value_queue_alloc_node(q);
+    memcpy(neo->value, value, q->size);
+
+    while (1)
+    {
+        struct value_node *cur_tail = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(q->tail));
+        struct value_node *cur_tail_next = atomic_load_explicit(&(cur_tail->next), memory_order_acquire);
+        if (cur_tail_next != NULL)
+        {
+            // the tail is lagging behind, help it along before trying again
+            atomic_compare_exchange_strong_explicit(&(q->tail), &cur_tail, cur_tail_next, memory_order_release, memory_order_relaxed);
+            continue;
+        }
+
+        if (atomic_compare_exchange_strong_explicit(&(cur_tail->next), &cur_tail_next, neo, memory_order_release, memory_order_relaxed))
+        {
+            atomic_compare_exchange_strong_explicit(&(q->tail), &cur_tail, neo, memory_order_release, memory_order_relaxed);
+            break;
+        }
+    }
+
+    atm_reclaim_exit(guard, 1);
+}
+
+bool atm_value_queue_try_dequeue(atm_value_queue *q, void *out)
+{
+    // protects the head and the node after it, whose value we copy out before trying to claim it
+    unsigned int guard = atm_reclaim_enter(2);
+    struct value_node *cur_head;
+
+    while (1)
+    {
+        cur_head = atm_reclaim_protect(guard, 0, (void *_Atomic *)&(q->head));
+        struct value_node *cur_head_next = atm_reclaim_protect(guard, 1, (void *_Atomic *)&(cur_head->next));
+
+        // the next node is only guaranteed to still be linked while head hasn't moved
+        if (atomic_load_explicit(&(q->head), memory_order_acquire) != cur_head)
+            continue;
+
+        if (cur_head_next == NULL)
+        {
+            atm_reclaim_exit(guard, 2);
+            return false;
+        }
+
+        // never retire a node the tail still points at, help the tail past it first
+        struct value_node *cur_tail = atomic_load_explicit(&(q->tail), memory_order_acquire);
+        if (cur_tail == cur_head)
+        {
+            atomic_compare_exchange_strong_explicit(&(q->tail), &cur_tail, cur_head_next, memory_order_release, memory_order_relaxed);
+            continue;
+        }
+
+        // copy first, the node stays protected so a losing copy is simply discarded. The winner
+        // makes next the new sentinel and its value is never read again
+        memcpy(out, cur_head_next->value, q->size);
+        if (atomic_compare_exchange_strong_explicit(&(q->head), &cur_head, cur_head_next, memory_order_acq_rel, memory_order_relaxed))
+            break;
+    }
+
+    cur_head->retire_epoch = atm_reclaim_tag();
+    atm_value_queue_push(&(q->retired), cur_head, cur_head);
+    atm_reclaim_exit(guard, 2);
+
+    if (atm_reclaim_tick(1) && !atm_reclaimer_defer(&(q->deferred)))
+        atm_value_queue_reclaim(q);
+
+    return true;
+}
+
+void atm_value_queue_reclaim(atm_value_queue *q)
+{
+    // take the whole retired stack, nodes that aren't safe yet get pushed back
+    struct value_node *node = atomic_exchange_explicit(&(q->retired), NULL, memory_order_acquire);
+    struct reclaim_scan scan;
+    atm_reclaim_scan_begin(&scan);
+
+    struct value_node *safe_first = NULL;
+    struct value_node *safe_last = NULL;
+    struct value_node *keep_first = NULL;
+    struct value_node *keep_last = NULL;
+
+    while (node)
+    {
+        struct value_node *temp = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        if (atm_reclaim_is_safe(&scan, node, node->retire_epoch))
+        {
+            atomic_store_explicit(&(node->free_next), safe_first, memory_order_relaxed);
+            if (!safe_last)
+                safe_last = node;
+            safe_first = node;
+        }
+        else
+        {
+            atomic_store_explicit(&(node->free_next), keep_first, memory_order_relaxed);
+            if (!keep_last)
+                keep_last = node;
+            keep_first = node;
+        }
+        node = temp;
+    }
+
+    atm_reclaim_scan_end(&scan);
+
+    if (keep_first)
+        atm_value_queue_push(&(q->retired), keep_first, keep_last);
+
+    // no thread can still see these nodes, return them to the pool
+    if (safe_first)
+        atm_value_queue_push(&(q->free_nodes), safe_first, safe_last);
+}
+
+static void free_value_node_list(struct value_node *node)
+{
+    while (node)
+    {
+        struct value_node *temp = atomic_load_explicit(&(node->free_next), memory_order_relaxed);
+        free(node);
+        node = temp;
+    }
+}
+
+void free_atm_value_queue(atm_value_queue *q)
+{
+    free_atm_value_queue_auto(q);
+    free(q);
+}
+
+void free_atm_value_queue_auto(atm_value_queue *q)
+{
+    atm_reclaimer_cancel(&(q->deferred));
+
+    // values live inside the nodes, so there is no payload to free
+    free_value_node_list(atomic_exchange_explicit(&(q->retired), NULL, memory_order_relaxed));
+
+    struct value_node *cur = atomic_load_explicit(&(q->head), memory_order_relaxed);
+    while (cur)
+    {
+        struct value_node *temp = atomic_load_explicit(&(cur->next), memory_order_relaxed);
+        free(cur);
+        cur = temp;
+    }
+
+    free_value_node_list(atomic_exchange_explicit(&(q->free_nodes), NULL, memory_order_relaxed));
+}
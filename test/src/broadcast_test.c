@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include "broadcast.h"
+
+struct broadcast_args {
+    atm_broadcast *b;
+    size_t consumer;
+    int niter;
+    long long sum;
+};
+
+static int *make_int(int i)
+{
+    int *val = malloc(sizeof(int));
+    *val = i;
+    return val;
+}
+
+int test_broadcast_single_threaded()
+{
+    atm_broadcast b;
+    atm_broadcast_init(&b, 5, 2);
+
+    if (atm_broadcast_capacity(&b) != 8)
+    {
+        fprintf(stderr, "expected capacity to round up to 8, got %zu\n", atm_broadcast_capacity(&b));
+        return 1;
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        if (!atm_broadcast_try_publish(&b, make_int(i)))
+        {
+            fprintf(stderr, "publish %d failed before the ring was full\n", i);
+            return 1;
+        }
+    }
+
+    int *extra = make_int(-1);
+    if (atm_broadcast_try_publish(&b, extra))
+    {
+        fprintf(stderr, "publish succeeded on a full ring\n");
+        return 1;
+    }
+
+    // both consumers see every item in order
+    for (size_t c = 0; c < 2; c++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            int *val = atm_broadcast_try_read(&b, c);
+            if (val == NULL || *val != i)
+            {
+                fprintf(stderr, "consumer %zu read %d, expected %d\n", c, val ? *val : -1, i);
+                return 1;
+            }
+        }
+    }
+
+    // the producer is held back by the slowest cursor, which still holds the last item it read
+    size_t n = 0;
+    while (atm_broadcast_try_publish(&b, extra))
+    {
+        n++;
+        extra = make_int(-1);
+    }
+    if (n != 3)
+    {
+        fprintf(stderr, "published %zu items behind the slowest cursor, expected 3\n", n);
+        return 1;
+    }
+
+    // consumer 0 racing ahead frees nothing while consumer 1 lags
+    void *out[16];
+    n = atm_broadcast_read_bulk(&b, 0, out, 16);
+    if (n != 7 || *(int *)out[0] != 4 || *(int *)out[3] != 7 || *(int *)out[4] != -1)
+    {
+        fprintf(stderr, "bulk read returned %zu items, expected 7 starting at 4\n", n);
+        return 1;
+    }
+    if (atm_broadcast_read_bulk(&b, 0, out, 16) != 0 || atm_broadcast_try_publish(&b, extra))
+    {
+        fprintf(stderr, "a caught up consumer let the producer past a lagging one\n");
+        return 1;
+    }
+
+    // once the lagging consumer leaves only the caught up one gates the producer
+    atm_broadcast_leave(&b, 1);
+    n = 0;
+    while (atm_broadcast_try_publish(&b, extra))
+    {
+        n++;
+        extra = make_int(-1);
+    }
+    if (n != 8)
+    {
+        fprintf(stderr, "published %zu items after the lagging consumer left, expected 8\n", n);
+        return 1;
+    }
+
+    free(extra);
+    free_atm_broadcast_auto(&b);
+
+    return 0;
+}
+
+void *broadcast_producer_thread_body(void *args)
+{
+    struct broadcast_args *ptr = (struct broadcast_args *)args;
+    printf("broadcast producer thread executing...\n");
+
+    for (int i = 0; i < ptr->niter; )
+    {
+        // alternate single and bulk publishes so both gate on the cursors
+        if (i % 2)
+        {
+            int *val = make_int(i);
+            while (!atm_broadcast_try_publish(ptr->b, val))
+                sched_yield();
+            i++;
+        }
+        else
+        {
+            void *items[16];
+            int n = ptr->niter - i < 16 ? ptr->niter - i : 16;
+            for (int j = 0; j < n; j++)
+                items[j] = make_int(i + j);
+
+            int done = 0;
+            while ((done += atm_broadcast_publish_bulk(ptr->b, items + done, n - done)) < n)
+                sched_yield();
+            i += n;
+        }
+    }
+
+    printf("broadcast producer thread finished.\n");
+    return NULL;
+}
+
+void *broadcast_consumer_thread_body(void *args)
+{
+    struct broadcast_args *ptr = (struct broadcast_args *)args;
+    int empty_count = 0;
+    int expected = 0;
+
+    while (expected < ptr->niter)
+    {
+        void *out[32];
+        size_t n;
+        if (ptr->consumer % 2)
+            n = (out[0] = atm_broadcast_try_read(ptr->b, ptr->consumer)) != NULL;
+        else
+            n = atm_broadcast_read_bulk(ptr->b, ptr->consumer, out, 32);
+
+        if (n == 0)
+        {
+            empty_count++;
+            sched_yield();
+            continue;
+        }
+
+        // every consumer must see every item in publish order
+        for (size_t i = 0; i < n; i++)
+        {
+            int val = *(int *)out[i];
+            if (val != expected)
+            {
+                fprintf(stderr, "consumer %zu received %d, expected %d\n", ptr->consumer, val, expected);
+                exit(1);
+            }
+            ptr->sum += val;
+            expected++;
+        }
+    }
+
+    atm_broadcast_leave(ptr->b, ptr->consumer);
+    printf("broadcast consumer %zu empty reads: %d\n", ptr->consumer, empty_count);
+    return NULL;
+}
+
+int test_broadcast_multi_threaded(int niter, int nconsumers)
+{
+    atm_broadcast b;
+    atm_broadcast_init(&b, 256, nconsumers);
+    pthread_t threads[nconsumers + 1];
+    struct broadcast_args args[nconsumers + 1];
+
+    for (int i = 0; i <= nconsumers; i++)
+    {
+        args[i] = (struct broadcast_args) { .b=&b, .consumer=i - 1, .niter=niter, .sum=0 };
+        int status;
+        if ((status = pthread_create(threads + i, NULL, i ? broadcast_consumer_thread_body : broadcast_producer_thread_body, args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i <= nconsumers; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    long long expected = (long long)niter * (niter - 1) / 2;
+    for (int i = 1; i <= nconsumers; i++)
+    {
+        if (args[i].sum != expected)
+        {
+            fprintf(stderr, "consumer %d summed %lld, expected %lld\n", i - 1, args[i].sum, expected);
+            return 1;
+        }
+    }
+
+    free_atm_broadcast_auto(&b);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_broadcast_single_threaded())
+        return 1;
+
+    if (test_broadcast_multi_threaded(1000000, 4))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "deque.h"
+
+struct deque_args {
+    atm_deque *d;
+    int niter;
+    _Atomic int *taken;
+    _Atomic bool *done;
+    _Atomic long long *sum;
+    long stolen;
+};
+
+int test_deque_single_threaded()
+{
+    atm_deque d;
+    atm_deque_init(&d, 4);
+
+    if (atm_deque_pop(&d) != NULL || atm_deque_steal(&d) != NULL)
+    {
+        fprintf(stderr, "took an item from an empty deque\n");
+        return 1;
+    }
+
+    // pushing well past the initial capacity makes the owner grow the array several times
+    for (int i = 0; i < 1000; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        atm_deque_push(&d, val);
+    }
+    if (atm_deque_size(&d) != 1000)
+    {
+        fprintf(stderr, "expected 1000 items, deque holds %zu\n", atm_deque_size(&d));
+        return 1;
+    }
+
+    // thieves take the oldest items, the owner the newest
+    for (int i = 0; i < 10; i++)
+    {
+        int *val = atm_deque_steal(&d);
+        if (val == NULL || *val != i)
+        {
+            fprintf(stderr, "unexpected value when stealing: %d != %d\n", val ? *val : -1, i);
+            return 1;
+        }
+        free(val);
+    }
+    for (int i = 999; i >= 10; i--)
+    {
+        int *val = atm_deque_pop(&d);
+        if (val == NULL || *val != i)
+        {
+            fprintf(stderr, "unexpected value when popping: %d != %d\n", val ? *val : -1, i);
+            return 1;
+        }
+        free(val);
+    }
+
+    if (atm_deque_pop(&d) != NULL || atm_deque_steal(&d) != NULL)
+    {
+        fprintf(stderr, "took an item from an empty deque\n");
+        return 1;
+    }
+
+    // leave some items behind for free to clean up
+    for (int i = 0; i < 10; i++)
+        atm_deque_push(&d, malloc(sizeof(int)));
+
+    free_atm_deque_auto(&d);
+    return 0;
+}
+
+void *deque_thief_body(void *arg)
+{
+    struct deque_args *args = (struct deque_args *)arg;
+    while (!atomic_load_explicit(args->done, memory_order_acquire))
+    {
+        int *val = atm_deque_steal(args->d);
+        if (!val)
+        {
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_add_explicit(args->sum, *val, memory_order_relaxed);
+        atomic_fetch_add_explicit(args->taken, 1, memory_order_relaxed);
+        args->stolen++;
+        free(val);
+    }
+    return NULL;
+}
+
+int test_deque_owner_and_thieves(int niter)
+{
+    atm_deque d;
+    atm_deque_init(&d, 2);
+
+    pthread_t thieves[3];
+    _Atomic int taken = 0;
+    _Atomic bool done = false;
+    _Atomic long long sum = 0;
+    struct deque_args args[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        args[i] = (struct deque_args) { .d=&d, .niter=niter, .taken=&taken, .done=&done, .sum=&sum, .stolen=0 };
+        int status;
+        if ((status = pthread_create(thieves + i, NULL, deque_thief_body, args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    // the owner pushes in bursts and pops some back, so it races thieves for the last item and grows under them
+    for (int i = 0; i < niter; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        atm_deque_push(&d, val);
+
+        if (i % 3 == 0 && (val = atm_deque_pop(&d)))
+        {
+            atomic_fetch_add_explicit(&sum, *val, memory_order_relaxed);
+            atomic_fetch_add_explicit(&taken, 1, memory_order_relaxed);
+            free(val);
+        }
+    }
+
+    int *val;
+    while ((val = atm_deque_pop(&d)))
+    {
+        atomic_fetch_add_explicit(&sum, *val, memory_order_relaxed);
+        atomic_fetch_add_explicit(&taken, 1, memory_order_relaxed);
+        free(val);
+    }
+
+    atomic_store_explicit(&done, true, memory_order_release);
+    long stolen = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        int status;
+        if ((status = pthread_join(thieves[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+        stolen += args[i].stolen;
+    }
+
+    // every item taken exactly once, by the owner or a thief
+    long long expected = (long long)niter * (niter - 1) / 2;
+    if (atomic_load(&taken) != niter || atomic_load(&sum) != expected)
+    {
+        fprintf(stderr, "took %d items summing to %lld, expected %d summing to %lld\n", atomic_load(&taken), atomic_load(&sum), niter, expected);
+        return 1;
+    }
+    printf("deque items stolen: %ld\n", stolen);
+
+    free_atm_deque_auto(&d);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_deque_single_threaded())
+        return 1;
+
+    if (test_deque_owner_and_thieves(1000000))
+        return 1;
+
+    return 0;
+}
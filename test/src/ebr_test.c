@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "ebr.h"
+
+struct pinned_args {
+    _Atomic int pinned;
+    _Atomic int release;
+};
+
+int test_ebr_advance_quiescent()
+{
+    // with no thread inside a critical section the epoch is free to move
+    unsigned long epoch = atm_ebr_retire_epoch();
+    if (atm_ebr_is_safe(epoch))
+    {
+        fprintf(stderr, "epoch %lu reported safe before advancing\n", epoch);
+        return 1;
+    }
+
+    if (!atm_ebr_try_advance() || !atm_ebr_try_advance())
+    {
+        fprintf(stderr, "unable to advance epoch with no active threads\n");
+        return 1;
+    }
+
+    if (!atm_ebr_is_safe(epoch))
+    {
+        fprintf(stderr, "epoch %lu not safe after advancing twice\n", epoch);
+        return 1;
+    }
+
+    return 0;
+}
+
+int test_ebr_nesting()
+{
+    unsigned long epoch = atm_ebr_retire_epoch();
+
+    atm_ebr_enter();
+    atm_ebr_enter();
+    atm_ebr_exit();
+
+    // still pinned by the outer section, the epoch can move once but not twice
+    atm_ebr_try_advance();
+    if (atm_ebr_try_advance())
+    {
+        fprintf(stderr, "epoch advanced twice past a nested critical section\n");
+        return 1;
+    }
+
+    atm_ebr_exit();
+
+    if (!atm_ebr_try_advance() || !atm_ebr_is_safe(epoch))
+    {
+        fprintf(stderr, "epoch did not advance once the critical section exited\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+void *pinned_thread_body(void *args)
+{
+    struct pinned_args *ptr = (struct pinned_args *)args;
+
+    atm_ebr_enter();
+    atomic_store(&(ptr->pinned), 1);
+    while (!atomic_load(&(ptr->release)))
+        sched_yield();
+    atm_ebr_exit();
+
+    return NULL;
+}
+
+int test_ebr_pinned_thread_blocks_advance()
+{
+    struct pinned_args args = { .pinned=0, .release=0 };
+    pthread_t thread;
+    int status;
+
+    if ((status = pthread_create(&thread, NULL, pinned_thread_body, &args)))
+    {
+        fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+        return 1;
+    }
+
+    while (!atomic_load(&(args.pinned)))
+        sched_yield();
+
+    unsigned long epoch = atm_ebr_retire_epoch();
+    atm_ebr_try_advance();
+    if (atm_ebr_try_advance() || atm_ebr_is_safe(epoch))
+    {
+        fprintf(stderr, "epoch advanced past a pinned thread\n");
+        return 1;
+    }
+
+    atomic_store(&(args.release), 1);
+    if ((status = pthread_join(thread, NULL)))
+    {
+        fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+        return 1;
+    }
+
+    if (!atm_ebr_try_advance() || !atm_ebr_is_safe(epoch))
+    {
+        fprintf(stderr, "epoch did not advance after pinned thread exited\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    if (test_ebr_advance_quiescent())
+        return 1;
+
+    if (test_ebr_nesting())
+        return 1;
+
+    if (test_ebr_pinned_thread_blocks_advance())
+        return 1;
+
+    return 0;
+}
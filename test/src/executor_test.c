@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "executor.h"
+
+static atm_executor *fib_ex;
+
+struct fib_args {
+    int n;
+    long result;
+};
+
+static void fib_task(void *arg)
+{
+    struct fib_args *args = (struct fib_args *)arg;
+    if (args->n < 2)
+    {
+        args->result = args->n;
+        return;
+    }
+
+    // spawn both halves onto this worker's deque and help out while waiting for them
+    struct fib_args left = { .n=args->n - 1 }, right = { .n=args->n - 2 };
+    struct atm_task_group group;
+    atm_task_group_init(&group);
+    atm_executor_submit(fib_ex, &group, fib_task, &left);
+    atm_executor_submit(fib_ex, &group, fib_task, &right);
+    atm_executor_wait(fib_ex, &group);
+    args->result = left.result + right.result;
+}
+
+int test_executor_nested_groups()
+{
+    atm_executor ex;
+    if (!atm_executor_init(&ex, 4))
+    {
+        fprintf(stderr, "unable to start executor\n");
+        return 1;
+    }
+    fib_ex = &ex;
+
+    struct fib_args args = { .n=20 };
+    struct atm_task_group group;
+    atm_task_group_init(&group);
+    atm_executor_submit(&ex, &group, fib_task, &args);
+    atm_executor_wait(&ex, &group);
+
+    if (args.result != 6765)
+    {
+        fprintf(stderr, "fib(20) computed as %ld, expected 6765\n", args.result);
+        return 1;
+    }
+
+    free_atm_executor_auto(&ex);
+    return 0;
+}
+
+struct count_args {
+    _Atomic long *sum;
+    long value;
+};
+
+static void count_task(void *arg)
+{
+    struct count_args *args = (struct count_args *)arg;
+    atomic_fetch_add_explicit(args->sum, args->value, memory_order_relaxed);
+    free(args);
+}
+
+struct submitter_args {
+    atm_executor *ex;
+    _Atomic long *sum;
+    int ntasks;
+};
+
+void *submitter_body(void *arg)
+{
+    // each outside thread waits on its own group while the others keep submitting
+    struct submitter_args *args = (struct submitter_args *)arg;
+    struct atm_task_group group;
+    atm_task_group_init(&group);
+    for (int i = 0; i < args->ntasks; i++)
+    {
+        struct count_args *task = malloc(sizeof(struct count_args));
+        *task = (struct count_args) { .sum=args->sum, .value=i };
+        atm_executor_submit(args->ex, &group, count_task, task);
+    }
+    atm_executor_wait(args->ex, &group);
+    return NULL;
+}
+
+int test_executor_external_submitters(int ntasks)
+{
+    atm_executor *ex = malloc(sizeof(atm_executor));
+    if (!atm_executor_init(ex, 3))
+    {
+        fprintf(stderr, "unable to start executor\n");
+        return 1;
+    }
+
+    pthread_t threads[4];
+    _Atomic long sum = 0;
+    struct submitter_args args = { .ex=ex, .sum=&sum, .ntasks=ntasks };
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_create(threads + i, NULL, submitter_body, &args)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    long expected = 4 * ((long)ntasks * (ntasks - 1) / 2);
+    if (atomic_load(&sum) != expected)
+    {
+        fprintf(stderr, "sum of task values %ld != %ld\n", atomic_load(&sum), expected);
+        return 1;
+    }
+
+    // tasks without a group still run before the executor shuts down
+    for (int i = 0; i < 1000; i++)
+    {
+        struct count_args *task = malloc(sizeof(struct count_args));
+        *task = (struct count_args) { .sum=&sum, .value=1 };
+        atm_executor_submit(ex, NULL, count_task, task);
+    }
+    free_atm_executor(ex);
+
+    if (atomic_load(&sum) != expected + 1000)
+    {
+        fprintf(stderr, "shutdown dropped %ld ungrouped tasks\n", expected + 1000 - atomic_load(&sum));
+        return 1;
+    }
+
+    return 0;
+}
+
+static void sleep_task(void *arg)
+{
+    struct timespec ts = { .tv_sec=0, .tv_nsec=200 * 1000000L };
+    nanosleep(&ts, NULL);
+    atomic_fetch_add_explicit((_Atomic int *)arg, 1, memory_order_relaxed);
+}
+
+struct waiter_args {
+    atm_executor *ex;
+    struct atm_task_group *group;
+    _Atomic int *done;
+    long cpu_ns;
+    int seen;
+};
+
+void *waiter_body(void *arg)
+{
+    // measure only this thread's cpu time, a waiter spinning on the group would burn the whole wait
+    struct waiter_args *args = (struct waiter_args *)arg;
+    struct timespec start, end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    atm_executor_wait(args->ex, args->group);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    args->cpu_ns = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+    args->seen = atomic_load_explicit(args->done, memory_order_relaxed);
+    return NULL;
+}
+
+int test_executor_outside_waiters_park()
+{
+    atm_executor ex;
+    if (!atm_executor_init(&ex, 2))
+    {
+        fprintf(stderr, "unable to start executor\n");
+        return 1;
+    }
+
+    // one 200ms task per worker, both picked up before anyone waits so there is nothing left to help with
+    _Atomic int done = 0;
+    struct atm_task_group group;
+    atm_task_group_init(&group);
+    for (int i = 0; i < 2; i++)
+        atm_executor_submit(&ex, &group, sleep_task, &done);
+    struct timespec ts = { .tv_sec=0, .tv_nsec=20 * 1000000L };
+    nanosleep(&ts, NULL);
+
+    pthread_t threads[3];
+    struct waiter_args args[3];
+    for (int i = 0; i < 3; i++)
+    {
+        args[i] = (struct waiter_args) { .ex=&ex, .group=&group, .done=&done };
+        int status;
+        if ((status = pthread_create(threads + i, NULL, waiter_body, args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+        if (args[i].seen != 2)
+        {
+            fprintf(stderr, "waiter returned after %d of 2 tasks\n", args[i].seen);
+            return 1;
+        }
+        if (args[i].cpu_ns > 20 * 1000000L)
+        {
+            fprintf(stderr, "waiter used %ldms of cpu waiting on the group\n", args[i].cpu_ns / 1000000L);
+            return 1;
+        }
+    }
+
+    free_atm_executor_auto(&ex);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_executor_nested_groups())
+        return 1;
+
+    if (test_executor_external_submitters(100000))
+        return 1;
+
+    if (test_executor_outside_waiters_park())
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "faa_queue.h"
+
+struct producer_args {
+    atm_faa_queue *q;
+    int niter;
+    int id;
+};
+
+struct consumer_args {
+    atm_faa_queue *q;
+    int nvals;
+    _Atomic int *total_consumed;
+    _Atomic long long *sum;
+    int failed;
+};
+
+int test_faa_queue_single_threaded()
+{
+    atm_faa_queue q;
+    atm_faa_queue_init(&q);
+
+    if (atm_faa_queue_dequeue(&q) != NULL)
+    {
+        fprintf(stderr, "dequeue succeeded on an empty queue\n");
+        return 1;
+    }
+
+    // fill several segments then drain them, polling the empty queue in between
+    int n = 5 * ATM_FAA_SEGMENT_SIZE + 7;
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            int *val = malloc(sizeof(int));
+            *val = i;
+            atm_faa_queue_enqueue(&q, val);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            int *val = atm_faa_queue_dequeue(&q);
+            if (val == NULL || *val != i)
+            {
+                fprintf(stderr, "unexpected value when dequeuing: %d != %d\n", val ? *val : -1, i);
+                return 1;
+            }
+            free(val);
+        }
+
+        for (int i = 0; i < 10; i++)
+        {
+            if (atm_faa_queue_dequeue(&q) != NULL)
+            {
+                fprintf(stderr, "expected queue to be empty after draining\n");
+                return 1;
+            }
+        }
+    }
+
+    // whatever is left in the queue is freed with it
+    for (int i = 0; i < 100; i++)
+        atm_faa_queue_enqueue(&q, malloc(sizeof(int)));
+
+    free_atm_faa_queue_auto(&q);
+
+    return 0;
+}
+
+void *producer_thread_body(void *args)
+{
+    struct producer_args *ptr = (struct producer_args *)args;
+
+    for (int i = 0; i < ptr->niter; i++)
+    {
+        int *val = malloc(2 * sizeof(int));
+        val[0] = ptr->id;
+        val[1] = i;
+        atm_faa_queue_enqueue(ptr->q, val);
+    }
+
+    return NULL;
+}
+
+void *consumer_thread_body(void *args)
+{
+    struct consumer_args *ptr = (struct consumer_args *)args;
+    int last[4] = { -1, -1, -1, -1 };
+
+    while (atomic_load_explicit(ptr->total_consumed, memory_order_relaxed) < ptr->nvals)
+    {
+        int *val = atm_faa_queue_dequeue(ptr->q);
+        if (val == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+
+        // each producer's items must reach any one consumer in the order they were enqueued
+        if (val[1] <= last[val[0]])
+        {
+            fprintf(stderr, "item %d from producer %d arrived after %d\n", val[1], val[0], last[val[0]]);
+            ptr->failed = 1;
+        }
+        last[val[0]] = val[1];
+
+        atomic_fetch_add_explicit(ptr->sum, val[1], memory_order_relaxed);
+        atomic_fetch_add_explicit(ptr->total_consumed, 1, memory_order_relaxed);
+        free(val);
+    }
+
+    return NULL;
+}
+
+int test_faa_queue_multi_producer_multi_consumer(int niter)
+{
+    atm_faa_queue *q = malloc(sizeof(atm_faa_queue));
+    atm_faa_queue_init(q);
+
+    pthread_t producer_threads[4], consumer_threads[4];
+    struct producer_args producer_args[4];
+    struct consumer_args consumer_args[4];
+    _Atomic int total_consumed = 0;
+    _Atomic long long sum = 0;
+    long long expected_sum = 4 * ((long long)niter * (niter - 1) / 2);
+
+    for (int i = 0; i < 4; i++)
+    {
+        consumer_args[i] = (struct consumer_args) { .q=q, .nvals=4*niter, .total_consumed=&total_consumed, .sum=&sum, .failed=0 };
+        int status;
+        if ((status = pthread_create(consumer_threads + i, NULL, consumer_thread_body, consumer_args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        producer_args[i] = (struct producer_args) { .q=q, .niter=niter, .id=i };
+        int status;
+        if ((status = pthread_create(producer_threads + i, NULL, producer_thread_body, producer_args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(producer_threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(consumer_threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+        if (consumer_args[i].failed)
+            return 1;
+    }
+
+    if (atomic_load(&sum) != expected_sum)
+    {
+        fprintf(stderr, "sum of consumed items %lld != %lld\n", atomic_load(&sum), expected_sum);
+        return 1;
+    }
+
+    if (atm_faa_queue_dequeue(q) != NULL)
+    {
+        fprintf(stderr, "expected queue to be empty after consuming every item\n");
+        return 1;
+    }
+
+    free_atm_faa_queue(q);
+
+    return 0;
+}
+
+int main(void)
+{
+    if (test_faa_queue_single_threaded())
+        return 1;
+
+    if (test_faa_queue_multi_producer_multi_consumer(250000))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "hp.h"
+
+struct holder_args {
+    void *_Atomic *src;
+    _Atomic int held;
+    _Atomic int release;
+};
+
+int test_hp_protect_and_exit()
+{
+    int a = 1, b = 2;
+    void *_Atomic src = &a;
+
+    unsigned int outer = atm_hp_enter(1);
+    unsigned int inner = atm_hp_enter(1);
+    if (inner != outer + 1)
+    {
+        fprintf(stderr, "nested enter did not stack slots: %u after %u\n", inner, outer);
+        return 1;
+    }
+
+    void *pa = atm_hp_protect(outer, &src);
+    atomic_store(&src, &b);
+    void *pb = atm_hp_protect(inner, &src);
+
+    struct hp_snapshot snap;
+    atm_hp_snapshot(&snap);
+    if (pa != &a || pb != &b || !atm_hp_snapshot_contains(&snap, &a) || !atm_hp_snapshot_contains(&snap, &b))
+    {
+        fprintf(stderr, "protected pointers missing from snapshot\n");
+        return 1;
+    }
+
+    // leaving the inner operation drops only its own hazard
+    atm_hp_exit(inner, 1);
+    atm_hp_snapshot(&snap);
+    if (!atm_hp_snapshot_contains(&snap, &a) || atm_hp_snapshot_contains(&snap, &b))
+    {
+        fprintf(stderr, "inner exit cleared the wrong hazard\n");
+        return 1;
+    }
+
+    atm_hp_exit(outer, 1);
+    atm_hp_snapshot(&snap);
+    if (atm_hp_snapshot_contains(&snap, &a))
+    {
+        fprintf(stderr, "hazard still published after exit\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+void *holder_thread_body(void *args)
+{
+    struct holder_args *ptr = (struct holder_args *)args;
+
+    unsigned int guard = atm_hp_enter(1);
+    atm_hp_protect(guard, ptr->src);
+    atomic_store(&(ptr->held), 1);
+    while (!atomic_load(&(ptr->release)))
+        sched_yield();
+    atm_hp_exit(guard, 1);
+
+    return NULL;
+}
+
+int test_hp_other_thread_hazard()
+{
+    int a = 1;
+    void *_Atomic src = &a;
+    struct holder_args args = { .src=&src, .held=0, .release=0 };
+    pthread_t thread;
+    int status;
+
+    if ((status = pthread_create(&thread, NULL, holder_thread_body, &args)))
+    {
+        fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+        return 1;
+    }
+
+    while (!atomic_load(&(args.held)))
+        sched_yield();
+
+    // the pointer is unlinked but another thread still holds it, a scan must keep it
+    atomic_store(&src, NULL);
+    struct hp_snapshot snap;
+    atm_hp_snapshot(&snap);
+    if (!atm_hp_snapshot_contains(&snap, &a))
+    {
+        fprintf(stderr, "scan missed a hazard published by another thread\n");
+        return 1;
+    }
+
+    atomic_store(&(args.release), 1);
+    if ((status = pthread_join(thread, NULL)))
+    {
+        fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+        return 1;
+    }
+
+    atm_hp_snapshot(&snap);
+    if (atm_hp_snapshot_contains(&snap, &a))
+    {
+        fprintf(stderr, "hazard survived its thread exiting\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    if (test_hp_protect_and_exit())
+        return 1;
+
+    if (test_hp_other_thread_hazard())
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "map.h"
+
+static void *cpy_value(void *data)
+{
+    uint64_t *copy = malloc(sizeof(uint64_t));
+    *copy = *(uint64_t *)data;
+    return copy;
+}
+
+static uint64_t *new_value(uint64_t v)
+{
+    uint64_t *val = malloc(sizeof(uint64_t));
+    *val = v;
+    return val;
+}
+
+int test_map_single_threaded()
+{
+    atm_map map;
+    atm_map_init(&map, cpy_value);
+
+    if (atm_map_get(&map, 7) != NULL || atm_map_remove(&map, 7))
+    {
+        fprintf(stderr, "found a key in an empty map\n");
+        return 1;
+    }
+
+    // enough keys to grow the table several times over
+    for (uint64_t i = 0; i < 10000; i++)
+        atm_map_put(&map, i, new_value(i * 2));
+    if (atm_map_size(&map) != 10000)
+    {
+        fprintf(stderr, "expected 10000 keys, map holds %zu\n", atm_map_size(&map));
+        return 1;
+    }
+
+    // replace every even key and remove every third
+    for (uint64_t i = 0; i < 10000; i += 2)
+        atm_map_put(&map, i, new_value(i * 3));
+    for (uint64_t i = 0; i < 10000; i += 3)
+    {
+        if (!atm_map_remove(&map, i))
+        {
+            fprintf(stderr, "unable to remove key %lu\n", (unsigned long)i);
+            return 1;
+        }
+    }
+
+    size_t expected_size = 0;
+    for (uint64_t i = 0; i < 10000; i++)
+    {
+        uint64_t *val = atm_map_get(&map, i);
+        if (i % 3 == 0)
+        {
+            if (val || atm_map_contains(&map, i))
+            {
+                fprintf(stderr, "removed key %lu still present\n", (unsigned long)i);
+                return 1;
+            }
+            continue;
+        }
+
+        uint64_t expected = i % 2 == 0 ? i * 3 : i * 2;
+        if (!val || *val != expected)
+        {
+            fprintf(stderr, "unexpected value for key %lu: %lu != %lu\n", (unsigned long)i, val ? (unsigned long)*val : 0, (unsigned long)expected);
+            return 1;
+        }
+        free(val);
+        expected_size++;
+    }
+    if (atm_map_size(&map) != expected_size)
+    {
+        fprintf(stderr, "expected %zu keys, map holds %zu\n", expected_size, atm_map_size(&map));
+        return 1;
+    }
+
+    // values can be read in place while the section is held
+    const uint64_t *val = atm_map_read_lock(&map, 5);
+    if (!val || *val != 10)
+    {
+        fprintf(stderr, "unexpected value read in place: %lu != 10\n", val ? (unsigned long)*val : 0);
+        return 1;
+    }
+    atm_map_read_unlock(&map);
+
+    struct map_table *t = atomic_load(&map.table);
+    if (t->mask + 1 < 10000 / ATM_MAP_LOAD_FACTOR)
+    {
+        fprintf(stderr, "table never grew past %zu buckets\n", t->mask + 1);
+        return 1;
+    }
+
+    free_atm_map_auto(&map);
+    return 0;
+}
+
+int test_map_read_during_resize()
+{
+    atm_map map;
+    atm_map_init(&map, cpy_value);
+
+    // fill the first table right up to its load factor
+    uint64_t nkeys = ATM_MAP_INITIAL_BUCKETS * ATM_MAP_LOAD_FACTOR;
+    for (uint64_t i = 0; i < nkeys; i++)
+        atm_map_put(&map, i, new_value(i * 2));
+
+    // hold a value through the node in the first table, the next puts grow the map and move every old bucket
+    const uint64_t *val = atm_map_read_lock(&map, 5);
+    for (uint64_t i = nkeys; i < nkeys + ATM_MAP_INITIAL_BUCKETS; i++)
+        atm_map_put(&map, i, new_value(i * 2));
+
+    struct map_table *t = atomic_load(&map.table);
+    if (t->mask + 1 == ATM_MAP_INITIAL_BUCKETS || atomic_load(&t->prev) != NULL)
+    {
+        fprintf(stderr, "expected a finished resize, table has %zu buckets\n", t->mask + 1);
+        return 1;
+    }
+
+    // replacing the key retires the copy the resize made, under hazard pointers only the old node is still
+    // protected so the value has to outlive the copy. Fresh allocations would reuse it if it had been freed
+    atm_map_put(&map, 5, new_value(500));
+    atm_map_reclaim(&map);
+    uint64_t *scratch[64];
+    for (int i = 0; i < 64; i++)
+        scratch[i] = new_value(0xdead);
+
+    if (*val != 10)
+    {
+        fprintf(stderr, "value read across a resize changed under the reader: %lu != 10\n", (unsigned long)*val);
+        return 1;
+    }
+    atm_map_read_unlock(&map);
+
+    for (int i = 0; i < 64; i++)
+        free(scratch[i]);
+
+    uint64_t *cur = atm_map_get(&map, 5);
+    if (!cur || *cur != 500)
+    {
+        fprintf(stderr, "unexpected value after the resize: %lu != 500\n", cur ? (unsigned long)*cur : 0);
+        return 1;
+    }
+    free(cur);
+
+    free_atm_map_auto(&map);
+    return 0;
+}
+
+struct map_args {
+    atm_map *map;
+    uint64_t first;
+    uint64_t nkeys;
+    int niter;
+    _Atomic bool *done;
+    long hits;
+    int failed;
+};
+
+// values hold the key in the high half and a version in the low half
+void *map_writer_body(void *arg)
+{
+    struct map_args *args = (struct map_args *)arg;
+    for (int n = 0; n < args->niter; n++)
+    {
+        for (uint64_t i = 0; i < args->nkeys; i++)
+        {
+            uint64_t key = args->first + i;
+            if ((i + n) % 5 == 0)
+                atm_map_remove(args->map, key);
+            else
+                atm_map_put(args->map, key, new_value(key << 32 | (uint64_t)n));
+        }
+    }
+    return NULL;
+}
+
+void *map_reader_body(void *arg)
+{
+    struct map_args *args = (struct map_args *)arg;
+    uint64_t key = args->first;
+    while (!atomic_load_explicit(args->done, memory_order_acquire))
+    {
+        key = (key * 6364136223846793005ULL + 1442695040888963407ULL);
+        uint64_t k = (key >> 33) % args->nkeys;
+
+        const uint64_t *val = atm_map_read_lock(args->map, k);
+        if (val)
+        {
+            // a torn or freed value would show up as the wrong key
+            if (*val >> 32 != k)
+            {
+                fprintf(stderr, "key %lu read a value for key %lu\n", (unsigned long)k, (unsigned long)(*val >> 32));
+                args->failed = 1;
+            }
+            args->hits++;
+        }
+        atm_map_read_unlock(args->map);
+    }
+    return NULL;
+}
+
+int test_map_readers_and_writers(int niter)
+{
+    atm_map *map = aligned_alloc(ATM_CACHE_LINE, sizeof(atm_map));
+    atm_map_init(map, cpy_value);
+
+    const uint64_t nkeys = 2000;
+    pthread_t writers[4], readers[4];
+    struct map_args wargs[4], rargs[4];
+    _Atomic bool done = false;
+
+    for (int i = 0; i < 4; i++)
+    {
+        rargs[i] = (struct map_args) { .map=map, .first=i + 1, .nkeys=4 * nkeys, .done=&done };
+        int status;
+        if ((status = pthread_create(readers + i, NULL, map_reader_body, rargs + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    // each writer owns its own range of keys, so the final contents are known
+    for (int i = 0; i < 4; i++)
+    {
+        wargs[i] = (struct map_args) { .map=map, .first=i * nkeys, .nkeys=nkeys, .niter=niter };
+        int status;
+        if ((status = pthread_create(writers + i, NULL, map_writer_body, wargs + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(writers[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    atomic_store_explicit(&done, true, memory_order_release);
+    long hits = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(readers[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+        if (rargs[i].failed)
+            return 1;
+        hits += rargs[i].hits;
+    }
+
+    // the last pass removed keys where (i + niter - 1) % 5 == 0 and wrote the rest
+    size_t expected_size = 0;
+    for (uint64_t key = 0; key < 4 * nkeys; key++)
+    {
+        uint64_t i = key % nkeys;
+        uint64_t *val = atm_map_get(map, key);
+        if ((i + niter - 1) % 5 == 0)
+        {
+            if (val)
+            {
+                fprintf(stderr, "removed key %lu still present\n", (unsigned long)key);
+                return 1;
+            }
+            continue;
+        }
+
+        uint64_t expected = key << 32 | (uint64_t)(niter - 1);
+        if (!val || *val != expected)
+        {
+            fprintf(stderr, "unexpected value for key %lu: %lx != %lx\n", (unsigned long)key, val ? (unsigned long)*val : 0, (unsigned long)expected);
+            return 1;
+        }
+        free(val);
+        expected_size++;
+    }
+    if (atm_map_size(map) != expected_size)
+    {
+        fprintf(stderr, "expected %zu keys, map holds %zu\n", expected_size, atm_map_size(map));
+        return 1;
+    }
+    printf("map reader hits: %ld\n", hits);
+
+    free_atm_map(map);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_map_single_threaded())
+        return 1;
+
+    if (test_map_read_during_resize())
+        return 1;
+
+    if (test_map_readers_and_writers(50))
+        return 1;
+
+    return 0;
+}
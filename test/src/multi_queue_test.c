@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "multi_queue.h"
+
+struct producer_args {
+    atm_multi_queue *mq;
+    int niter;
+    int id;
+};
+
+struct consumer_args {
+    atm_multi_queue *mq;
+    int nvals;
+    _Atomic int *total_consumed;
+    _Atomic long long *sum;
+};
+
+int test_multi_queue_single_threaded()
+{
+    atm_multi_queue mq;
+    atm_multi_queue_init(&mq, 4);
+
+    if (atm_multi_queue_dequeue(&mq) != NULL)
+    {
+        fprintf(stderr, "dequeue succeeded on an empty multi queue\n");
+        return 1;
+    }
+
+    // one thread enqueues to a single home shard, so its items still come back in order
+    for (int i = 0; i < 1000; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        atm_multi_queue_enqueue(&mq, val);
+    }
+
+    for (int i = 0; i < 1000; i++)
+    {
+        int *val = atm_multi_queue_dequeue(&mq);
+        if (val == NULL || *val != i)
+        {
+            fprintf(stderr, "unexpected value when dequeuing: %d != %d\n", val ? *val : -1, i);
+            return 1;
+        }
+        free(val);
+    }
+
+    if (atm_multi_queue_dequeue(&mq) != NULL)
+    {
+        fprintf(stderr, "expected multi queue to be empty after draining\n");
+        return 1;
+    }
+
+    free_atm_multi_queue_auto(&mq);
+
+    return 0;
+}
+
+void *producer_thread_body(void *args)
+{
+    struct producer_args *ptr = (struct producer_args *)args;
+
+    for (int i = 0; i < ptr->niter; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        atm_multi_queue_enqueue(ptr->mq, val);
+    }
+
+    return NULL;
+}
+
+void *consumer_thread_body(void *args)
+{
+    struct consumer_args *ptr = (struct consumer_args *)args;
+
+    while (atomic_load_explicit(ptr->total_consumed, memory_order_relaxed) < ptr->nvals)
+    {
+        int *val = atm_multi_queue_dequeue(ptr->mq);
+        if (val == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+
+        atomic_fetch_add_explicit(ptr->sum, *val, memory_order_relaxed);
+        atomic_fetch_add_explicit(ptr->total_consumed, 1, memory_order_relaxed);
+        free(val);
+    }
+
+    return NULL;
+}
+
+int test_multi_queue_multi_producer_multi_consumer(int niter)
+{
+    atm_multi_queue *mq = malloc(sizeof(atm_multi_queue));
+    atm_multi_queue_init(mq, 4);
+
+    // more consumers than producers, so some consumers' home shards never see an item and they have to steal
+    pthread_t producer_threads[3], consumer_threads[5];
+    struct producer_args producer_args[3];
+    _Atomic int total_consumed = 0;
+    _Atomic long long sum = 0;
+    struct consumer_args consumer_args = { .mq=mq, .nvals=3*niter, .total_consumed=&total_consumed, .sum=&sum };
+    long long expected_sum = 3 * ((long long)niter * (niter - 1) / 2);
+
+    for (int i = 0; i < 5; i++)
+    {
+        int status;
+        if ((status = pthread_create(consumer_threads + i, NULL, consumer_thread_body, &consumer_args)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        producer_args[i] = (struct producer_args) { .mq=mq, .niter=niter, .id=i };
+        int status;
+        if ((status = pthread_create(producer_threads + i, NULL, producer_thread_body, producer_args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        int status;
+        if ((status = pthread_join(producer_threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 5; i++)
+    {
+        int status;
+        if ((status = pthread_join(consumer_threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    if (atomic_load(&sum) != expected_sum)
+    {
+        fprintf(stderr, "sum of consumed items %lld != %lld\n", atomic_load(&sum), expected_sum);
+        return 1;
+    }
+
+    if (atm_multi_queue_dequeue(mq) != NULL)
+    {
+        fprintf(stderr, "expected multi queue to be empty after consuming every item\n");
+        return 1;
+    }
+
+    free_atm_multi_queue(mq);
+
+    return 0;
+}
+
+int main(void)
+{
+    if (test_multi_queue_single_threaded())
+        return 1;
+
+    if (test_multi_queue_multi_producer_multi_consumer(200000))
+        return 1;
+
+    return 0;
+}
@@ -4,7 +4,10 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
 #include "queue.h"
+#include "ebr.h"
 
 struct single_producer_args {
     atm_queue *q;
@@ -47,6 +50,161 @@ int test_queue_single_threaded()
 }
 
 
+int test_queue_node_pool_reuse()
+{
+    atm_queue q;
+    atm_queue_init(&q);
+
+    // cycle values through the queue so retired nodes make it back into the pool
+    for (int i = 0; i < 100; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        atm_queue_enqueue(&q, (void*)val);
+    }
+
+    for (int i = 0; i < 100; i++)
+        free(atm_queue_dequeue(&q));
+
+    // no thread is reading, so two epoch advances make every retired node safe to recycle
+    atm_ebr_try_advance();
+    atm_ebr_try_advance();
+    atm_queue_reclaim(&q);
+
+    struct queue_node *pooled = atomic_load(&q.free_nodes);
+    if (pooled == NULL)
+    {
+        fprintf(stderr, "expected retired nodes to be returned to the pool\n");
+        return 1;
+    }
+
+    // the next enqueue should be served from the pool rather than the heap
+    int *val = malloc(sizeof(int));
+    *val = 100;
+    atm_queue_enqueue(&q, (void*)val);
+    if (atomic_load(&q.tail) != pooled)
+    {
+        fprintf(stderr, "enqueue did not reuse a pooled node\n");
+        return 1;
+    }
+
+    free_atm_queue_auto(&q);
+
+    return 0;
+}
+
+
+int test_queue_stats()
+{
+    atm_queue q;
+    atm_queue_init(&q);
+
+    for (int i = 0; i < 100; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        atm_queue_enqueue(&q, (void*)val);
+    }
+
+    for (int i = 0; i < 100; i++)
+        free(atm_queue_dequeue(&q));
+    atm_queue_dequeue(&q);
+
+    atm_ebr_try_advance();
+    atm_ebr_try_advance();
+    atm_queue_reclaim(&q);
+
+    struct atm_stats stats;
+    atm_queue_stats(&q, &stats);
+
+#ifdef ATM_STATS
+    // single threaded, so there is nothing to retry against
+    if (stats.cas_retries != 0 || stats.empty_dequeues != 1)
+    {
+        fprintf(stderr, "expected 0 retries and 1 empty dequeue, got %lu and %lu\n", stats.cas_retries, stats.empty_dequeues);
+        return 1;
+    }
+
+    if (stats.retired != 100 || stats.freed != 100 || stats.backlog != 0)
+    {
+        fprintf(stderr, "expected 100 nodes retired and freed, got %lu retired %lu freed %lu backlog\n",
+                stats.retired, stats.freed, stats.backlog);
+        return 1;
+    }
+#else
+    // counters are compiled out, the snapshot should read as zero
+    if (stats.cas_retries || stats.empty_dequeues || stats.epoch_advances || stats.retired || stats.freed || stats.backlog)
+    {
+        fprintf(stderr, "expected empty stats without ATM_STATS\n");
+        return 1;
+    }
+#endif
+
+    free_atm_queue_auto(&q);
+
+    return 0;
+}
+
+int test_queue_bulk_single_threaded()
+{
+    atm_queue q;
+    atm_queue_init(&q);
+
+    // enqueue in batches, mixed with single enqueues
+    int next = 0;
+    for (int batch = 0; batch < 100; batch++)
+    {
+        void *items[64];
+        for (int i = 0; i < 64; i++)
+        {
+            int *val = malloc(sizeof(int));
+            *val = next++;
+            items[i] = val;
+        }
+        atm_queue_enqueue_bulk(&q, items, 64);
+
+        int *val = malloc(sizeof(int));
+        *val = next++;
+        atm_queue_enqueue(&q, val);
+    }
+
+    // drain with a batch size that doesn't line up with the enqueue batches
+    int expected = 0;
+    void *out[50];
+    size_t n;
+    while ((n = atm_queue_dequeue_bulk(&q, out, 50)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            int *val = (int*) out[i];
+            if (*val != expected)
+            {
+                fprintf(stderr, "unexpected value when bulk dequeuing: %d != %d\n", *val, expected);
+                return 1;
+            }
+            expected++;
+            free(val);
+        }
+    }
+
+    if (expected != next)
+    {
+        fprintf(stderr, "bulk dequeue drained %d of %d values\n", expected, next);
+        return 1;
+    }
+
+    if (atm_queue_dequeue(&q) != NULL)
+    {
+        fprintf(stderr, "expected queue to be empty after bulk dequeue\n");
+        return 1;
+    }
+
+    free_atm_queue_auto(&q);
+
+    return 0;
+}
+
+
 void *single_producer_thread_body(void *args)
 {
     struct single_producer_args *ptr = (struct single_producer_args *)args;
@@ -100,6 +258,106 @@ void *single_consumer_thread_body(void *args)
     return NULL;
 }
 
+void *bulk_producer_thread_body(void *args)
+{
+    struct single_producer_args *ptr = (struct single_producer_args *)args;
+    int niter = ptr->niter;
+    int id = ptr->id;
+
+    void *items[64];
+    int n = 0;
+    for (int i = 0; i < niter; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = (7 * i) + id;
+        items[n++] = val;
+        if (n == 64 || i == niter - 1)
+        {
+            atm_queue_enqueue_bulk(ptr->q, items, n);
+            n = 0;
+        }
+    }
+
+    return NULL;
+}
+
+void *bulk_consumer_thread_body(void *args)
+{
+    struct single_consumer_args *ptr = (struct single_consumer_args *)args;
+    int nvals = ptr->nvals;
+    int received = 0;
+
+    // values from each producer must come out in the order that producer enqueued them
+    int last_seen[7] = { -1, -1, -1, -1, -1, -1, -1 };
+    void *out[32];
+
+    while (received < nvals)
+    {
+        size_t n = atm_queue_dequeue_bulk(ptr->q, out, 32);
+        for (size_t i = 0; i < n; i++)
+        {
+            int val = *(int*)out[i];
+            int id = val % 7;
+            if (val <= last_seen[id])
+            {
+                fprintf(stderr, "bulk consumer received %d after %d from producer %d\n", val, last_seen[id], id);
+                exit(1);
+            }
+            last_seen[id] = val;
+            free(out[i]);
+        }
+        received += n;
+    }
+
+    return NULL;
+}
+
+int test_queue_multi_threaded_bulk(int niter)
+{
+    atm_queue q;
+    atm_queue_init(&q);
+    pthread_t consumer_thread, producer_threads[3];
+
+    struct single_consumer_args consumer_args = { .q=&q, .nvals=3*niter };
+    struct single_producer_args producer_args[3];
+    for (int i = 0; i < 3; i++)
+        producer_args[i] = (struct single_producer_args) { .q=&q, .niter=niter, .id=i + 1 };
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (pthread_create(producer_threads + i, NULL, bulk_producer_thread_body, producer_args + i))
+        {
+            fprintf(stderr, "unable to spawn producer thread: (%d) %s\n", errno, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (pthread_create(&consumer_thread, NULL, bulk_consumer_thread_body, &consumer_args))
+    {
+        fprintf(stderr, "unable to spawn consumer thread: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (pthread_join(producer_threads[i], NULL))
+        {
+            fprintf(stderr, "unable to join producer thread: (%d) %s\n", errno, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (pthread_join(consumer_thread, NULL))
+    {
+        fprintf(stderr, "unable to join consumer thread: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    free_atm_queue_auto(&q);
+    return 0;
+}
+
+
 int test_queue_multi_threaded_single_producer_single_consumer(int niter)
 {
     atm_queue q;
@@ -347,11 +605,108 @@ int test_queue_multi_threaded_multi_producer_multi_consumer(unsigned int niter)
 }
 
 
+static long long elapsed_ns(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000000LL + (now.tv_nsec - start->tv_nsec);
+}
+
+int test_queue_dequeue_wait_timeout()
+{
+    atm_queue q;
+    atm_queue_init(&q);
+
+    // nothing is ever enqueued, the wait must give up after the timeout
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    void *res = atm_queue_dequeue_wait(&q, 2000000);
+    long long waited = elapsed_ns(&start);
+
+    if (res != NULL)
+    {
+        fprintf(stderr, "dequeue_wait returned data from an empty queue\n");
+        return 1;
+    }
+
+    if (waited < 2000000)
+    {
+        fprintf(stderr, "dequeue_wait returned after %lld ns, before its 2 ms timeout\n", waited);
+        return 1;
+    }
+
+    free_atm_queue_auto(&q);
+    return 0;
+}
+
+void *slow_producer_thread_body(void *args)
+{
+    struct single_producer_args *ptr = (struct single_producer_args *)args;
+
+    // produce in bursts with gaps long enough for the consumer to park
+    for (int i = 0; i < ptr->niter; i++)
+    {
+        if (i % 100 == 0)
+            usleep(1000);
+
+        int *val = malloc(sizeof(int));
+        *val = i;
+        atm_queue_enqueue(ptr->q, val);
+    }
+
+    return NULL;
+}
+
+int test_queue_dequeue_wait_blocking(int niter)
+{
+    atm_queue q;
+    atm_queue_init(&q);
+    pthread_t producer_thread;
+    struct single_producer_args producer_args = { .q=&q, .niter=niter, .id=0 };
+
+    if (pthread_create(&producer_thread, NULL, slow_producer_thread_body, &producer_args))
+    {
+        fprintf(stderr, "unable to spawn producer thread: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    // every value must arrive in order, a lost wake up would show up as a timeout
+    for (int i = 0; i < niter; i++)
+    {
+        int *val = atm_queue_dequeue_wait(&q, 1000000000LL);
+        if (val == NULL || *val != i)
+        {
+            fprintf(stderr, "dequeue_wait received %d, expected %d\n", val ? *val : -1, i);
+            return 1;
+        }
+        free(val);
+    }
+
+    if (pthread_join(producer_thread, NULL))
+    {
+        fprintf(stderr, "unable to join producer thread: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    free_atm_queue_auto(&q);
+    return 0;
+}
+
+
 int main(void)
 {
     if (test_queue_single_threaded())
         return 1;
 
+    if (test_queue_node_pool_reuse())
+        return 1;
+
+    if (test_queue_bulk_single_threaded())
+        return 1;
+
+    if (test_queue_stats())
+        return 1;
+
     if (test_queue_multi_threaded_single_producer_single_consumer(1000))
         return 1;
 
@@ -360,6 +715,15 @@ int main(void)
 
     if (test_queue_multi_threaded_multi_producer_multi_consumer(1000000))
         return 1;
+
+    if (test_queue_multi_threaded_bulk(100000))
+        return 1;
+
+    if (test_queue_dequeue_wait_timeout())
+        return 1;
+
+    if (test_queue_dequeue_wait_blocking(10000))
+        return 1;
     
     return 0;
 }
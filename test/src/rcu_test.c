@@ -3,6 +3,7 @@
 #include <pthread.h>
 #include <errno.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "rcu.h"
 
 struct thread_params {
@@ -144,6 +145,478 @@ int test_rcu_without_init()
 }
 
 
+struct reader_params {
+    rcu_t *rcu;
+    _Atomic int *done;
+};
+
+void *reader_body(void *arg)
+{
+    struct reader_params *params = (struct reader_params*) arg;
+
+    // keep reads overlapping for as long as the writer is running
+    while (!atomic_load_explicit(params->done, memory_order_relaxed))
+        free(rcu_read(params->rcu));
+
+    return NULL;
+}
+
+int test_rcu_retired_bounded_under_readers()
+{
+    rcu_t *rcu = malloc(sizeof(rcu_t));
+    rcu_init_with(rcu, cpy, calloc(26, sizeof(int)));
+    _Atomic int done = 0;
+    pthread_t readers[4];
+    struct reader_params params = { .rcu=rcu, .done=&done };
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_create(readers + i, NULL, reader_body, &params)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 100000; i++)
+        rcu_update(rcu, calloc(26, sizeof(int)));
+
+    atomic_store(&done, 1);
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(readers[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    // readers never all go quiet at once, the retired backlog must still have been reclaimed as we went
+    size_t backlog = 0;
+    for (rcunode_t *node = atomic_load(&(rcu->retired)); node; node = node->next)
+        backlog++;
+
+    printf("retired backlog after 100000 updates: %zu\n", backlog);
+    if (backlog > 50000)
+    {
+        fprintf(stderr, "retired backlog grew to %zu nodes\n", backlog);
+        return 1;
+    }
+
+    free_rcu(rcu);
+    return 0;
+}
+
+
+struct locked_reader_params {
+    rcu_t *rcu;
+    _Atomic int *done;
+    int failed;
+};
+
+void *locked_reader_body(void *arg)
+{
+    struct locked_reader_params *params = (struct locked_reader_params*) arg;
+
+    while (!atomic_load_explicit(params->done, memory_order_relaxed))
+    {
+        // every published version has all of its entries equal, a torn or reclaimed read would show up here
+        const int *cur = rcu_read_lock(params->rcu);
+        for (size_t i = 1; cur && i < 26; i++)
+        {
+            if (cur[i] != cur[0])
+            {
+                fprintf(stderr, "inconsistent read in locked section: %d != %d\n", cur[i], cur[0]);
+                params->failed = 1;
+            }
+        }
+        rcu_read_unlock(params->rcu);
+    }
+
+    return NULL;
+}
+
+int test_rcu_read_lock()
+{
+    rcu_t *rcu = malloc(sizeof(rcu_t));
+    rcu_init_with(rcu, cpy, calloc(26, sizeof(int)));
+    _Atomic int done = 0;
+    pthread_t readers[4];
+    struct locked_reader_params params[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        params[i] = (struct locked_reader_params) { .rcu=rcu, .done=&done, .failed=0 };
+        int status;
+        if ((status = pthread_create(readers + i, NULL, locked_reader_body, params + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int v = 1; v <= 100000; v++)
+    {
+        int *next = malloc(26 * sizeof(int));
+        for (size_t i = 0; i < 26; i++)
+            next[i] = v;
+        rcu_update(rcu, next);
+    }
+
+    atomic_store(&done, 1);
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(readers[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+        if (params[i].failed)
+            return 1;
+    }
+
+    // locks nest, the outer section keeps its pointer valid after the inner one is released
+    const int *outer = rcu_read_lock(rcu);
+    const int *inner = rcu_read_lock(rcu);
+    rcu_read_unlock(rcu);
+    if (outer != inner || outer[0] != 100000)
+    {
+        fprintf(stderr, "nested read lock saw %d, expected 100000\n", outer[0]);
+        return 1;
+    }
+    rcu_read_unlock(rcu);
+
+    free_rcu(rcu);
+    return 0;
+}
+
+
+void increment(void *data, void *ctx)
+{
+    int *buf = (int*)data;
+    char c = *(char*)ctx;
+    buf[c % 'a']++;
+}
+
+void *update_fn_thread_body(void *arg)
+{
+    struct thread_params *params = (struct thread_params*) arg;
+
+    for (size_t i = 0; i < params->iter; i++)
+        rcu_update_fn(params->rcu, increment, &(params->c));
+
+    return NULL;
+}
+
+int test_rcu_update_fn()
+{
+    rcu_t *rcu = malloc(sizeof(rcu_t));
+    rcu_init(rcu, cpy);
+
+    // no version has been published yet, so there is nothing to mutate
+    char c = 'a';
+    if (rcu_update_fn(rcu, increment, &c))
+    {
+        fprintf(stderr, "rcu_update_fn succeeded without a published version\n");
+        return 1;
+    }
+
+    rcu_update(rcu, calloc(26, sizeof(int)));
+    pthread_t threads[26];
+    struct thread_params params[26];
+
+    for (int i = 0; i < 26; i++)
+    {
+        params[i].rcu = rcu;
+        params[i].c = (char)(i + 'a');
+        params[i].iter = 10000;
+
+        int status;
+        if ((status = pthread_create(threads + i, NULL, update_fn_thread_body, params + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 26; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    // read-modify-write updates must never be lost
+    int *res = rcu_read(rcu);
+    for (size_t i = 0; i < 26; i++)
+    {
+        if (res[i] != 10000)
+        {
+            fprintf(stderr, "count for %c is %d, expected 10000\n", (char)i + 'a', res[i]);
+            return 1;
+        }
+    }
+
+    free(res);
+    free_rcu(rcu);
+    return 0;
+}
+
+
+void *combined_thread_body(void *arg)
+{
+    struct thread_params *params = (struct thread_params*) arg;
+
+    for (size_t i = 0; i < params->iter; i++)
+        rcu_update_combined(params->rcu, increment, &(params->c));
+
+    return NULL;
+}
+
+int test_rcu_update_combined()
+{
+    rcu_t *rcu = malloc(sizeof(rcu_t));
+    rcu_init(rcu, cpy);
+
+    char c = 'a';
+    if (rcu_update_combined(rcu, increment, &c))
+    {
+        fprintf(stderr, "rcu_update_combined succeeded without a published version\n");
+        return 1;
+    }
+
+    rcu_update(rcu, calloc(26, sizeof(int)));
+    pthread_t threads[26];
+    struct thread_params params[26];
+
+    for (int i = 0; i < 26; i++)
+    {
+        params[i].rcu = rcu;
+        params[i].c = (char)(i + 'a');
+        params[i].iter = 10000;
+
+        int status;
+        if ((status = pthread_create(threads + i, NULL, combined_thread_body, params + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 26; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    // every mutation is applied exactly once, however the combiner batched them
+    unsigned long version;
+    int *res = rcu_read_versioned(rcu, &version);
+    for (size_t i = 0; i < 26; i++)
+    {
+        if (res[i] != 10000)
+        {
+            fprintf(stderr, "count for %c is %d, expected 10000\n", (char)i + 'a', res[i]);
+            return 1;
+        }
+    }
+
+    // one version is published per batch, never more than one per mutation
+    printf("260000 combined updates published %lu versions\n", version - 1);
+    if (version - 1 > 260000)
+    {
+        fprintf(stderr, "combining published more versions than updates\n");
+        return 1;
+    }
+
+    free(res);
+    free_rcu(rcu);
+    return 0;
+}
+
+
+void *update_if_thread_body(void *arg)
+{
+    struct thread_params *params = (struct thread_params*) arg;
+
+    for (size_t i = 0; i < params->iter; i++)
+    {
+        // optimistic read-modify-write, retry from the newer version whenever another writer got in first
+        while (1)
+        {
+            unsigned long version;
+            int *cur = rcu_read_versioned(params->rcu, &version);
+            cur[params->c % 'a']++;
+            if (rcu_update_if(params->rcu, cur, version))
+                break;
+            free(cur);
+        }
+    }
+
+    return NULL;
+}
+
+int test_rcu_versioned()
+{
+    rcu_t *rcu = malloc(sizeof(rcu_t));
+    rcu_init(rcu, cpy);
+
+    unsigned long version;
+    if (rcu_read_versioned(rcu, &version) != NULL || version != 0 || rcu_version(rcu) != 0)
+    {
+        fprintf(stderr, "expected version 0 before anything is published\n");
+        return 1;
+    }
+
+    // a stale expected version must be refused and leave the current data alone
+    int *first = calloc(26, sizeof(int));
+    if (rcu_update_if(rcu, first, 1) || !rcu_update_if(rcu, first, 0) || rcu_version(rcu) != 1)
+    {
+        fprintf(stderr, "conditional update did not respect the expected version\n");
+        return 1;
+    }
+
+    rcu_update(rcu, calloc(26, sizeof(int)));
+    int *stale = calloc(26, sizeof(int));
+    if (rcu_update_if(rcu, stale, 1) || rcu_version(rcu) != 2)
+    {
+        fprintf(stderr, "conditional update succeeded against a stale version\n");
+        return 1;
+    }
+    free(stale);
+
+    pthread_t threads[26];
+    struct thread_params params[26];
+
+    for (int i = 0; i < 26; i++)
+    {
+        params[i].rcu = rcu;
+        params[i].c = (char)(i + 'a');
+        params[i].iter = 1000;
+
+        int status;
+        if ((status = pthread_create(threads + i, NULL, update_if_thread_body, params + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 26; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    // no write is lost, and every successful update moved the version on by exactly one
+    int *res = rcu_read_versioned(rcu, &version);
+    for (size_t i = 0; i < 26; i++)
+    {
+        if (res[i] != 1000)
+        {
+            fprintf(stderr, "count for %c is %d, expected 1000\n", (char)i + 'a', res[i]);
+            return 1;
+        }
+    }
+
+    if (version != 2 + 26 * 1000)
+    {
+        fprintf(stderr, "version is %lu, expected %d\n", version, 2 + 26 * 1000);
+        return 1;
+    }
+
+    free(res);
+    free_rcu(rcu);
+    return 0;
+}
+
+
+void *stats_thread_body(void *arg)
+{
+    struct thread_params *params = (struct thread_params*) arg;
+
+    for (size_t i = 0; i < params->iter; i++)
+        rcu_update(params->rcu, calloc(26, sizeof(int)));
+
+    return NULL;
+}
+
+int test_rcu_stats()
+{
+    rcu_t *rcu = malloc(sizeof(rcu_t));
+    rcu_init_with(rcu, cpy, calloc(26, sizeof(int)));
+    pthread_t threads[4];
+    struct thread_params params[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        params[i] = (struct thread_params) { .rcu=rcu, .c='a', .iter=10000 };
+        int status;
+        if ((status = pthread_create(threads + i, NULL, stats_thread_body, params + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    struct atm_stats stats;
+    rcu_stats(rcu, &stats);
+    printf("retries: %lu retired: %lu freed: %lu backlog: %lu epoch advances: %lu\n",
+           stats.cas_retries, stats.retired, stats.freed, stats.backlog, stats.epoch_advances);
+
+#ifdef ATM_STATS
+    // every update retires exactly the version it replaced
+    if (stats.retired != 40000 || stats.freed + stats.backlog != stats.retired)
+    {
+        fprintf(stderr, "expected 40000 retired nodes split between freed and backlog\n");
+        return 1;
+    }
+
+    size_t backlog = 0;
+    for (rcunode_t *node = atomic_load(&(rcu->retired)); node; node = node->next)
+        backlog++;
+    if (backlog != stats.backlog)
+    {
+        fprintf(stderr, "stats report a backlog of %lu but %zu nodes are retired\n", stats.backlog, backlog);
+        return 1;
+    }
+#else
+    if (stats.cas_retries || stats.retired || stats.freed || stats.backlog)
+    {
+        fprintf(stderr, "expected empty stats without ATM_STATS\n");
+        return 1;
+    }
+#endif
+
+    free_rcu(rcu);
+    return 0;
+}
+
+
 int main(void)
 {
     printf("Testing rcu with initial data...\n");
@@ -153,6 +626,30 @@ int main(void)
     printf("Testing rcu without initial data...\n");
     if (test_rcu_without_init())
         return 1;
+
+    printf("Testing rcu retired backlog under overlapping readers...\n");
+    if (test_rcu_retired_bounded_under_readers())
+        return 1;
+
+    printf("Testing zero copy read side critical sections...\n");
+    if (test_rcu_read_lock())
+        return 1;
+
+    printf("Testing atomic read-modify-write updates...\n");
+    if (test_rcu_update_fn())
+        return 1;
+
+    printf("Testing combined updates...\n");
+    if (test_rcu_update_combined())
+        return 1;
+
+    printf("Testing versioned reads and conditional updates...\n");
+    if (test_rcu_versioned())
+        return 1;
+
+    printf("Testing contention and reclamation stats...\n");
+    if (test_rcu_stats())
+        return 1;
         
     return 0;
 }
@@ -0,0 +1,304 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "reclaimer.h"
+#include "queue.h"
+#include "rcu.h"
+
+struct work_args {
+    _Atomic int runs;
+    _Atomic int started;
+    _Atomic int finished;
+    pthread_t runner;
+    int sleep_ms;
+};
+
+void work_body(void *arg)
+{
+    struct work_args *args = (struct work_args *)arg;
+    args->runner = pthread_self();
+    atomic_store(&(args->started), 1);
+
+    struct timespec ts = { .tv_sec=0, .tv_nsec=args->sleep_ms * 1000000L };
+    if (args->sleep_ms)
+        nanosleep(&ts, NULL);
+
+    atomic_store(&(args->finished), 1);
+    atomic_fetch_add(&(args->runs), 1);
+}
+
+static int wait_for(_Atomic int *flag)
+{
+    // give the reclaimer up to a few seconds on a loaded machine
+    for (int i = 0; i < 5000 && !atomic_load(flag); i++)
+    {
+        struct timespec ts = { .tv_sec=0, .tv_nsec=1000000L };
+        nanosleep(&ts, NULL);
+    }
+    return atomic_load(flag);
+}
+
+int test_reclaimer_runs_deferred_work()
+{
+    struct work_args args = { .runs=0, .started=0, .finished=0, .sleep_ms=0 };
+    struct atm_deferred work;
+    atm_deferred_init(&work, work_body, &args);
+
+    if (atm_reclaimer_defer(&work))
+    {
+        fprintf(stderr, "defer accepted work without a running reclaimer\n");
+        return 1;
+    }
+
+    if (!atm_reclaimer_start())
+    {
+        fprintf(stderr, "unable to start the reclaimer\n");
+        return 1;
+    }
+
+    if (!atm_reclaimer_defer(&work) || !wait_for(&(args.finished)))
+    {
+        fprintf(stderr, "deferred work never ran\n");
+        return 1;
+    }
+
+    if (pthread_equal(args.runner, pthread_self()))
+    {
+        fprintf(stderr, "deferred work ran on the deferring thread\n");
+        return 1;
+    }
+
+    atm_reclaimer_stop();
+    if (atm_reclaimer_running() || atm_reclaimer_defer(&work))
+    {
+        fprintf(stderr, "reclaimer still accepting work after stop\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int test_reclaimer_cancel_waits_for_running_work()
+{
+    struct work_args args = { .runs=0, .started=0, .finished=0, .sleep_ms=50 };
+    struct atm_deferred work;
+    atm_deferred_init(&work, work_body, &args);
+    atm_reclaimer_start();
+
+    // defer again while the pass is running, cancel must drop the rerun and wait for the pass
+    atm_reclaimer_defer(&work);
+    if (!wait_for(&(args.started)))
+    {
+        fprintf(stderr, "deferred work never started\n");
+        return 1;
+    }
+    atm_reclaimer_defer(&work);
+    atm_reclaimer_cancel(&work);
+
+    if (!atomic_load(&(args.finished)))
+    {
+        fprintf(stderr, "cancel returned while the work was still running\n");
+        return 1;
+    }
+
+    atm_reclaimer_stop();
+    if (atomic_load(&(args.runs)) != 1)
+    {
+        fprintf(stderr, "cancelled work ran %d times\n", atomic_load(&(args.runs)));
+        return 1;
+    }
+
+    return 0;
+}
+
+struct queue_args {
+    atm_queue *q;
+    int niter;
+    _Atomic int *total_consumed;
+    _Atomic long long *sum;
+};
+
+void *producer_body(void *arg)
+{
+    struct queue_args *args = (struct queue_args *)arg;
+    for (int i = 0; i < args->niter; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        atm_queue_enqueue(args->q, val);
+    }
+    return NULL;
+}
+
+void *consumer_body(void *arg)
+{
+    struct queue_args *args = (struct queue_args *)arg;
+    while (atomic_load_explicit(args->total_consumed, memory_order_relaxed) < 4 * args->niter)
+    {
+        int *val = atm_queue_dequeue(args->q);
+        if (!val)
+        {
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_add_explicit(args->sum, *val, memory_order_relaxed);
+        atomic_fetch_add_explicit(args->total_consumed, 1, memory_order_relaxed);
+        free(val);
+    }
+    return NULL;
+}
+
+int test_reclaimer_queue_multi_producer_multi_consumer(int niter)
+{
+    atm_queue *q = malloc(sizeof(atm_queue));
+    atm_queue_init(q);
+    atm_reclaimer_start();
+
+    pthread_t threads[8];
+    _Atomic int total_consumed = 0;
+    _Atomic long long sum = 0;
+    struct queue_args args = { .q=q, .niter=niter, .total_consumed=&total_consumed, .sum=&sum };
+
+    for (int i = 0; i < 8; i++)
+    {
+        int status;
+        if ((status = pthread_create(threads + i, NULL, i < 4 ? producer_body : consumer_body, &args)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    long long expected = 4 * ((long long)niter * (niter - 1) / 2);
+    if (atomic_load(&sum) != expected)
+    {
+        fprintf(stderr, "sum of consumed items %lld != %lld\n", atomic_load(&sum), expected);
+        return 1;
+    }
+
+    // retired nodes made it back into the pool without the consumers reclaiming themselves. Passes that ran
+    // while consumers were still inside critical sections may have found nothing safe, with every thread
+    // joined two more passes move the epoch past everything retired
+    for (int i = 0; i < 2; i++)
+    {
+        atm_reclaimer_defer(&(q->deferred));
+        atm_reclaimer_flush(&(q->deferred));
+    }
+    if (atomic_load(&(q->free_nodes)) == NULL)
+    {
+        fprintf(stderr, "expected the reclaimer to have recycled retired nodes\n");
+        return 1;
+    }
+
+    // freeing with the reclaimer still running must wait out any pass in flight
+    free_atm_queue(q);
+    atm_reclaimer_stop();
+
+    return 0;
+}
+
+void *cpy(void *data)
+{
+    int *buf = malloc(26 * sizeof(int));
+    memcpy(buf, data, 26 * sizeof(int));
+    return buf;
+}
+
+struct reader_args {
+    rcu_t *rcu;
+    _Atomic int *done;
+};
+
+void *reader_body(void *arg)
+{
+    struct reader_args *args = (struct reader_args *)arg;
+    while (!atomic_load_explicit(args->done, memory_order_relaxed))
+    {
+        rcu_read_lock(args->rcu);
+        rcu_read_unlock(args->rcu);
+    }
+    return NULL;
+}
+
+int test_reclaimer_rcu_backlog()
+{
+    rcu_t *rcu = malloc(sizeof(rcu_t));
+    rcu_init_with(rcu, cpy, calloc(26, sizeof(int)));
+    atm_reclaimer_start();
+
+    pthread_t readers[2];
+    _Atomic int done = 0;
+    struct reader_args args = { .rcu=rcu, .done=&done };
+    for (int i = 0; i < 2; i++)
+    {
+        int status;
+        if ((status = pthread_create(readers + i, NULL, reader_body, &args)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 100000; i++)
+        rcu_update(rcu, calloc(26, sizeof(int)));
+
+    atomic_store(&done, 1);
+    for (int i = 0; i < 2; i++)
+    {
+        int status;
+        if ((status = pthread_join(readers[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    // stopping drains every pass still queued
+    atm_reclaimer_stop();
+
+    size_t backlog = 0;
+    for (rcunode_t *node = atomic_load(&(rcu->retired)); node; node = node->next)
+        backlog++;
+
+    printf("retired backlog with background reclamation: %zu\n", backlog);
+    if (backlog > 50000)
+    {
+        fprintf(stderr, "retired backlog grew to %zu nodes\n", backlog);
+        return 1;
+    }
+
+    free_rcu(rcu);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_reclaimer_runs_deferred_work())
+        return 1;
+
+    if (test_reclaimer_cancel_waits_for_running_work())
+        return 1;
+
+    if (test_reclaimer_queue_multi_producer_multi_consumer(100000))
+        return 1;
+
+    if (test_reclaimer_rcu_backlog())
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "ring.h"
+
+struct producer_args {
+    atm_ring *r;
+    int niter;
+    int id;
+};
+
+struct consumer_args {
+    atm_ring *r;
+    int nvals;
+    _Atomic int *total_consumed;
+    _Atomic long long *sum;
+};
+
+int test_ring_single_threaded()
+{
+    atm_ring r;
+    atm_ring_init(&r, 1000);
+
+    if (atm_ring_capacity(&r) != 1024)
+    {
+        fprintf(stderr, "expected capacity to round up to 1024, got %zu\n", atm_ring_capacity(&r));
+        return 1;
+    }
+
+    // fill the ring to capacity, the next enqueue must be refused
+    for (int i = 0; i < 1024; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        if (!atm_ring_try_enqueue(&r, val))
+        {
+            fprintf(stderr, "enqueue %d failed before ring was full\n", i);
+            return 1;
+        }
+    }
+
+    int extra = -1;
+    if (atm_ring_try_enqueue(&r, &extra))
+    {
+        fprintf(stderr, "enqueue succeeded on a full ring\n");
+        return 1;
+    }
+
+    // wrap around several laps to exercise sequence numbers
+    for (int lap = 0; lap < 5; lap++)
+    {
+        for (int i = 0; i < 1024; i++)
+        {
+            int *val = atm_ring_try_dequeue(&r);
+            int expected = lap * 1024 + i;
+            if (val == NULL || *val != expected)
+            {
+                fprintf(stderr, "unexpected value when dequeuing: %d != %d\n", val ? *val : -1, expected);
+                return 1;
+            }
+            *val = expected + 1024;
+            if (!atm_ring_try_enqueue(&r, val))
+            {
+                fprintf(stderr, "enqueue failed after dequeue freed a slot\n");
+                return 1;
+            }
+        }
+    }
+
+    free_atm_ring_auto(&r);
+
+    return 0;
+}
+
+void *producer_thread_body(void *args)
+{
+    struct producer_args *ptr = (struct producer_args *)args;
+    printf("Ring producer thread %d executing...\n", ptr->id);
+
+    for (int i = 0; i < ptr->niter; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = (7 * i) + ptr->id;
+        // back off while the ring is full
+        while (!atm_ring_try_enqueue(ptr->r, val))
+            sched_yield();
+    }
+
+    printf("Ring producer thread %d finished.\n", ptr->id);
+    return NULL;
+}
+
+void *consumer_thread_body(void *args)
+{
+    struct consumer_args *ptr = (struct consumer_args *)args;
+    int empty_count = 0;
+
+    while (atomic_load_explicit(ptr->total_consumed, memory_order_relaxed) < ptr->nvals)
+    {
+        int *val = atm_ring_try_dequeue(ptr->r);
+        if (val == NULL)
+        {
+            empty_count++;
+            sched_yield();
+            continue;
+        }
+
+        atomic_fetch_add_explicit(ptr->sum, *val, memory_order_relaxed);
+        atomic_fetch_add_explicit(ptr->total_consumed, 1, memory_order_relaxed);
+        free(val);
+    }
+
+    printf("Ring consumer empty dequeues: %d\n", empty_count);
+    return NULL;
+}
+
+int test_ring_multi_producer_multi_consumer(int niter)
+{
+    atm_ring r;
+    atm_ring_init(&r, 64);
+
+    pthread_t producer_threads[4], consumer_threads[3];
+    struct producer_args producer_args[4];
+    _Atomic int total_consumed = 0;
+    _Atomic long long sum = 0;
+    struct consumer_args consumer_args = { .r=&r, .nvals=4*niter, .total_consumed=&total_consumed, .sum=&sum };
+
+    long long expected_sum = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        producer_args[i] = (struct producer_args) { .r=&r, .niter=niter, .id=i + 1 };
+        for (int j = 0; j < niter; j++)
+            expected_sum += (7 * j) + i + 1;
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (pthread_create(producer_threads + i, NULL, producer_thread_body, producer_args + i))
+        {
+            fprintf(stderr, "unable to spawn producer thread: (%d) %s\n", errno, strerror(errno));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (pthread_create(consumer_threads + i, NULL, consumer_thread_body, &consumer_args))
+        {
+            fprintf(stderr, "unable to spawn consumer thread: (%d) %s\n", errno, strerror(errno));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (pthread_join(producer_threads[i], NULL))
+        {
+            fprintf(stderr, "unable to join producer thread: (%d) %s\n", errno, strerror(errno));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (pthread_join(consumer_threads[i], NULL))
+        {
+            fprintf(stderr, "unable to join consumer thread: (%d) %s\n", errno, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (atomic_load(&sum) != expected_sum)
+    {
+        fprintf(stderr, "consumed values sum to %lld, expected %lld\n", atomic_load(&sum), expected_sum);
+        return 1;
+    }
+
+    free_atm_ring_auto(&r);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_ring_single_threaded())
+        return 1;
+
+    if (test_ring_multi_producer_multi_consumer(100000))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "seqlock.h"
+
+// 7 ints so the value doesn't fill its last word
+struct sample {
+    int vals[7];
+};
+
+struct reader_args {
+    atm_seqlock *s;
+    _Atomic int *done;
+    int failed;
+};
+
+struct writer_args {
+    atm_seqlock *s;
+    int niter;
+    int id;
+};
+
+int test_seqlock_single_threaded()
+{
+    atm_seqlock s;
+    char too_big[ATM_SEQLOCK_SIZE + 1] = { 0 };
+    if (atm_seqlock_init(&s, sizeof(too_big), too_big))
+    {
+        fprintf(stderr, "init accepted a value larger than ATM_SEQLOCK_SIZE\n");
+        return 1;
+    }
+
+    atm_seqlock_init(&s, sizeof(struct sample), NULL);
+    struct sample out;
+    memset(&out, 0xff, sizeof(out));
+    if (atm_seqlock_read_versioned(&s, &out) != 0 || out.vals[0] != 0 || out.vals[6] != 0)
+    {
+        fprintf(stderr, "expected zeroed data at version 0\n");
+        return 1;
+    }
+
+    struct sample in = { { 1, 2, 3, 4, 5, 6, 7 } };
+    atm_seqlock_update(&s, &in);
+    atm_seqlock_read(&s, &out);
+    if (memcmp(&in, &out, sizeof(in)) != 0 || atm_seqlock_version(&s) != 1)
+    {
+        fprintf(stderr, "read did not return the published value\n");
+        return 1;
+    }
+
+    // a stale version is refused and leaves the value alone
+    struct sample stale = { { 0 } };
+    if (atm_seqlock_update_if(&s, &stale, 0) || !atm_seqlock_update_if(&s, &in, 1) || atm_seqlock_version(&s) != 2)
+    {
+        fprintf(stderr, "conditional update did not respect the expected version\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+void *reader_body(void *arg)
+{
+    struct reader_args *args = (struct reader_args *)arg;
+
+    while (!atomic_load_explicit(args->done, memory_order_relaxed))
+    {
+        // every published value has all of its entries equal, a torn read would show up here
+        struct sample out;
+        atm_seqlock_read(args->s, &out);
+        for (int i = 1; i < 7; i++)
+        {
+            if (out.vals[i] != out.vals[0])
+            {
+                fprintf(stderr, "torn read: %d != %d\n", out.vals[i], out.vals[0]);
+                args->failed = 1;
+                return NULL;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void *writer_body(void *arg)
+{
+    struct writer_args *args = (struct writer_args *)arg;
+
+    for (int i = 0; i < args->niter; i++)
+    {
+        struct sample in;
+        for (int j = 0; j < 7; j++)
+            in.vals[j] = args->id * args->niter + i;
+        atm_seqlock_update(args->s, &in);
+    }
+
+    return NULL;
+}
+
+int test_seqlock_readers_never_see_torn_values(int niter)
+{
+    atm_seqlock s;
+    struct sample init = { { 0 } };
+    atm_seqlock_init(&s, sizeof(init), &init);
+
+    pthread_t readers[3], writers[2];
+    struct reader_args reader_args[3];
+    struct writer_args writer_args[2];
+    _Atomic int done = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        reader_args[i] = (struct reader_args) { .s=&s, .done=&done, .failed=0 };
+        int status;
+        if ((status = pthread_create(readers + i, NULL, reader_body, reader_args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        writer_args[i] = (struct writer_args) { .s=&s, .niter=niter, .id=i };
+        int status;
+        if ((status = pthread_create(writers + i, NULL, writer_body, writer_args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        int status;
+        if ((status = pthread_join(writers[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    atomic_store(&done, 1);
+    for (int i = 0; i < 3; i++)
+    {
+        int status;
+        if ((status = pthread_join(readers[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+        if (reader_args[i].failed)
+            return 1;
+    }
+
+    if (atm_seqlock_version(&s) != 1 + 2 * (unsigned long)niter)
+    {
+        fprintf(stderr, "version is %lu, expected %lu\n", atm_seqlock_version(&s), 1 + 2 * (unsigned long)niter);
+        return 1;
+    }
+
+    return 0;
+}
+
+void *counter_body(void *arg)
+{
+    struct writer_args *args = (struct writer_args *)arg;
+
+    // optimistic increments, retried whenever another writer published first
+    for (int i = 0; i < args->niter; i++)
+    {
+        while (1)
+        {
+            long count;
+            unsigned long version = atm_seqlock_read_versioned(args->s, &count);
+            count++;
+            if (atm_seqlock_update_if(args->s, &count, version))
+                break;
+        }
+    }
+
+    return NULL;
+}
+
+int test_seqlock_update_if(int niter)
+{
+    atm_seqlock s;
+    long zero = 0;
+    atm_seqlock_init(&s, sizeof(long), &zero);
+
+    pthread_t threads[4];
+    struct writer_args args[4];
+    for (int i = 0; i < 4; i++)
+    {
+        args[i] = (struct writer_args) { .s=&s, .niter=niter, .id=i };
+        int status;
+        if ((status = pthread_create(threads + i, NULL, counter_body, args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    long count;
+    atm_seqlock_read(&s, &count);
+    if (count != 4L * niter)
+    {
+        fprintf(stderr, "counter is %ld, expected %ld\n", count, 4L * niter);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    if (test_seqlock_single_threaded())
+        return 1;
+
+    if (test_seqlock_readers_never_see_torn_values(200000))
+        return 1;
+
+    if (test_seqlock_update_if(50000))
+        return 1;
+
+    return 0;
+}
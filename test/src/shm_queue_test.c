@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "shm_queue.h"
+
+struct shm_item {
+    int producer;
+    long seq;
+};
+
+int test_shm_queue_single_threaded()
+{
+    // 12 bytes leaves a partial word at the end of each payload
+    size_t size = atm_shm_queue_region_size(100, 12);
+    atm_shm_queue *q = aligned_alloc(ATM_CACHE_LINE, (size + ATM_CACHE_LINE - 1) / ATM_CACHE_LINE * ATM_CACHE_LINE);
+
+    if (!atm_shm_queue_init(q, size, 12))
+    {
+        fprintf(stderr, "unable to init a queue in a region of %zu bytes\n", size);
+        return 1;
+    }
+    if (atm_shm_queue_capacity(q) != 100)
+    {
+        fprintf(stderr, "expected capacity 100, got %zu\n", atm_shm_queue_capacity(q));
+        return 1;
+    }
+    if (!atm_shm_queue_attach(q, size, 12) || atm_shm_queue_attach(q, size, 16) || atm_shm_queue_attach(q, size / 2, 12))
+    {
+        fprintf(stderr, "attach accepted a mismatched layout or refused a matching one\n");
+        return 1;
+    }
+
+    char item[12];
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            snprintf(item, sizeof(item), "item %6d", i);
+            if (!atm_shm_queue_try_enqueue(q, item))
+            {
+                fprintf(stderr, "enqueue %d failed before the queue was full\n", i);
+                return 1;
+            }
+        }
+        if (atm_shm_queue_try_enqueue(q, item))
+        {
+            fprintf(stderr, "enqueue succeeded on a full queue\n");
+            return 1;
+        }
+
+        // nodes go back to the pool, so every round sees the full capacity again
+        for (int i = 0; i < 100; i++)
+        {
+            char expected[12];
+            snprintf(expected, sizeof(expected), "item %6d", i);
+            if (!atm_shm_queue_try_dequeue(q, item) || memcmp(item, expected, sizeof(item)) != 0)
+            {
+                fprintf(stderr, "unexpected item when dequeuing %d\n", i);
+                return 1;
+            }
+        }
+        if (atm_shm_queue_try_dequeue(q, item))
+        {
+            fprintf(stderr, "dequeue succeeded on an empty queue\n");
+            return 1;
+        }
+    }
+
+    free(q);
+    return 0;
+}
+
+int test_shm_queue_multi_process(long niter, int nproducers)
+{
+    // back the queue with a file each process maps for itself, so every mapping lands at its own address
+    FILE *file = tmpfile();
+    if (!file)
+    {
+        fprintf(stderr, "unable to create backing file: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+    int fd = fileno(file);
+    size_t size = atm_shm_queue_region_size(64, sizeof(struct shm_item));
+    if (ftruncate(fd, size))
+    {
+        fprintf(stderr, "unable to size backing file: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    atm_shm_queue *q = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (q == MAP_FAILED || !atm_shm_queue_init(q, size, sizeof(struct shm_item)))
+    {
+        fprintf(stderr, "unable to map and init the queue\n");
+        return 1;
+    }
+
+    pid_t children[nproducers];
+    for (int p = 0; p < nproducers; p++)
+    {
+        if ((children[p] = fork()) < 0)
+        {
+            fprintf(stderr, "unable to fork producer: (%d) %s\n", errno, strerror(errno));
+            return 1;
+        }
+        if (children[p])
+            continue;
+
+        // keep the inherited mapping reserved so the fresh one cannot reuse its address
+        atm_shm_queue *mine = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mine == MAP_FAILED || mine == q || !atm_shm_queue_attach(mine, size, sizeof(struct shm_item)))
+            _exit(2);
+
+        for (long i = 0; i < niter; i++)
+        {
+            struct shm_item item = { .producer=p, .seq=i };
+            while (!atm_shm_queue_try_enqueue(mine, &item))
+                sched_yield();
+        }
+        _exit(0);
+    }
+
+    // per producer FIFO order has to hold across processes
+    long next[nproducers];
+    memset(next, 0, sizeof(next));
+    long empty_count = 0;
+    for (long received = 0; received < niter * nproducers; )
+    {
+        struct shm_item item;
+        if (!atm_shm_queue_try_dequeue(q, &item))
+        {
+            empty_count++;
+            sched_yield();
+            continue;
+        }
+        if (item.producer < 0 || item.producer >= nproducers || item.seq != next[item.producer])
+        {
+            fprintf(stderr, "received item %ld from producer %d out of order\n", item.seq, item.producer);
+            return 1;
+        }
+        next[item.producer]++;
+        received++;
+    }
+    printf("shm queue consumer empty dequeues: %ld\n", empty_count);
+
+    for (int p = 0; p < nproducers; p++)
+    {
+        int status;
+        if (waitpid(children[p], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "producer %d did not exit cleanly\n", p);
+            return 1;
+        }
+    }
+
+    struct shm_item item;
+    if (atm_shm_queue_try_dequeue(q, &item))
+    {
+        fprintf(stderr, "dequeue succeeded after every item was received\n");
+        return 1;
+    }
+
+    munmap(q, size);
+    fclose(file);
+    return 0;
+}
+
+struct shm_thread_args {
+    atm_shm_queue *q;
+    long niter;
+    _Atomic long *consumed;
+    _Atomic long long *sum;
+};
+
+void *shm_producer_body(void *arg)
+{
+    struct shm_thread_args *args = (struct shm_thread_args *)arg;
+    for (long i = 0; i < args->niter; i++)
+    {
+        struct shm_item item = { .producer=0, .seq=i };
+        while (!atm_shm_queue_try_enqueue(args->q, &item))
+            sched_yield();
+    }
+    return NULL;
+}
+
+void *shm_consumer_body(void *arg)
+{
+    struct shm_thread_args *args = (struct shm_thread_args *)arg;
+    while (atomic_load_explicit(args->consumed, memory_order_relaxed) < 4 * args->niter)
+    {
+        struct shm_item item;
+        if (!atm_shm_queue_try_dequeue(args->q, &item))
+        {
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_add_explicit(args->sum, item.seq, memory_order_relaxed);
+        atomic_fetch_add_explicit(args->consumed, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+int test_shm_queue_multi_producer_multi_consumer(long niter)
+{
+    // a small pool keeps nodes cycling through the free list while they are contended
+    size_t size = atm_shm_queue_region_size(16, sizeof(struct shm_item));
+    atm_shm_queue *q = aligned_alloc(ATM_CACHE_LINE, (size + ATM_CACHE_LINE - 1) / ATM_CACHE_LINE * ATM_CACHE_LINE);
+    atm_shm_queue_init(q, size, sizeof(struct shm_item));
+
+    pthread_t threads[8];
+    _Atomic long consumed = 0;
+    _Atomic long long sum = 0;
+    struct shm_thread_args args = { .q=q, .niter=niter, .consumed=&consumed, .sum=&sum };
+
+    for (int i = 0; i < 8; i++)
+    {
+        int status;
+        if ((status = pthread_create(threads + i, NULL, i < 4 ? shm_producer_body : shm_consumer_body, &args)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    long long expected = 4 * ((long long)niter * (niter - 1) / 2);
+    if (atomic_load(&sum) != expected)
+    {
+        fprintf(stderr, "sum of consumed items %lld != %lld\n", atomic_load(&sum), expected);
+        return 1;
+    }
+
+    free(q);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_shm_queue_single_threaded())
+        return 1;
+
+    if (test_shm_queue_multi_producer_multi_consumer(200000))
+        return 1;
+
+    if (test_shm_queue_multi_process(200000, 3))
+        return 1;
+
+    return 0;
+}
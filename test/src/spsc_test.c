@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include "spsc.h"
+
+struct spsc_args {
+    atm_spsc *q;
+    int niter;
+};
+
+int test_spsc_single_threaded()
+{
+    atm_spsc q;
+    atm_spsc_init(&q, 100);
+
+    if (atm_spsc_capacity(&q) != 128)
+    {
+        fprintf(stderr, "expected capacity to round up to 128, got %zu\n", atm_spsc_capacity(&q));
+        return 1;
+    }
+
+    for (int i = 0; i < 128; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        if (!atm_spsc_try_enqueue(&q, val))
+        {
+            fprintf(stderr, "enqueue %d failed before queue was full\n", i);
+            return 1;
+        }
+    }
+
+    int extra = -1;
+    if (atm_spsc_try_enqueue(&q, &extra))
+    {
+        fprintf(stderr, "enqueue succeeded on a full queue\n");
+        return 1;
+    }
+
+    for (int i = 0; i < 128; i++)
+    {
+        int *val = atm_spsc_try_dequeue(&q);
+        if (val == NULL || *val != i)
+        {
+            fprintf(stderr, "unexpected value when dequeuing: %d != %d\n", val ? *val : -1, i);
+            return 1;
+        }
+        free(val);
+    }
+
+    if (atm_spsc_try_dequeue(&q) != NULL)
+    {
+        fprintf(stderr, "dequeue succeeded on an empty queue\n");
+        return 1;
+    }
+
+    // bulk enqueue is truncated to the free space
+    void *items[200];
+    for (int i = 0; i < 200; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        items[i] = val;
+    }
+
+    size_t n = atm_spsc_enqueue_bulk(&q, items, 200);
+    if (n != 128)
+    {
+        fprintf(stderr, "bulk enqueue accepted %zu items, expected 128\n", n);
+        return 1;
+    }
+    for (int i = 128; i < 200; i++)
+        free(items[i]);
+
+    void *out[50];
+    int expected = 0;
+    while ((n = atm_spsc_dequeue_bulk(&q, out, 50)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (*(int*)out[i] != expected)
+            {
+                fprintf(stderr, "unexpected value when bulk dequeuing: %d != %d\n", *(int*)out[i], expected);
+                return 1;
+            }
+            expected++;
+            free(out[i]);
+        }
+    }
+
+    if (expected != 128)
+    {
+        fprintf(stderr, "bulk dequeue drained %d of 128 values\n", expected);
+        return 1;
+    }
+
+    free_atm_spsc_auto(&q);
+
+    return 0;
+}
+
+void *spsc_producer_thread_body(void *args)
+{
+    struct spsc_args *ptr = (struct spsc_args *)args;
+    printf("SPSC producer thread executing...\n");
+
+    for (int i = 0; i < ptr->niter; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        while (!atm_spsc_try_enqueue(ptr->q, val))
+            sched_yield();
+    }
+
+    printf("SPSC producer thread finished.\n");
+    return NULL;
+}
+
+void *spsc_consumer_thread_body(void *args)
+{
+    struct spsc_args *ptr = (struct spsc_args *)args;
+    int empty_count = 0;
+    int expected = 0;
+
+    while (expected < ptr->niter)
+    {
+        int *val = atm_spsc_try_dequeue(ptr->q);
+        if (val == NULL)
+        {
+            empty_count++;
+            sched_yield();
+            continue;
+        }
+
+        // a single producer and consumer must see strict FIFO order
+        if (*val != expected)
+        {
+            fprintf(stderr, "consumer received %d, expected %d\n", *val, expected);
+            exit(1);
+        }
+        expected++;
+        free(val);
+    }
+
+    printf("SPSC consumer empty dequeues: %d\n", empty_count);
+    return NULL;
+}
+
+int test_spsc_multi_threaded(int niter)
+{
+    atm_spsc q;
+    atm_spsc_init(&q, 256);
+    pthread_t producer_thread, consumer_thread;
+    struct spsc_args args = { .q=&q, .niter=niter };
+
+    if (pthread_create(&producer_thread, NULL, spsc_producer_thread_body, &args))
+    {
+        fprintf(stderr, "unable to spawn producer thread: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    if (pthread_create(&consumer_thread, NULL, spsc_consumer_thread_body, &args))
+    {
+        fprintf(stderr, "unable to spawn consumer thread: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    if (pthread_join(producer_thread, NULL))
+    {
+        fprintf(stderr, "unable to join producer thread: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    if (pthread_join(consumer_thread, NULL))
+    {
+        fprintf(stderr, "unable to join consumer thread: (%d) %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    free_atm_spsc_auto(&q);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_spsc_single_threaded())
+        return 1;
+
+    if (test_spsc_multi_threaded(1000000))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,378 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "stack.h"
+
+struct stack_args {
+    atm_stack *s;
+    int niter;
+    _Atomic int *total_consumed;
+    _Atomic long long *sum;
+};
+
+int test_stack_single_threaded()
+{
+    atm_stack s;
+    atm_stack_init(&s);
+
+    if (atm_stack_pop(&s) != NULL)
+    {
+        fprintf(stderr, "pop succeeded on an empty stack\n");
+        return 1;
+    }
+
+    // popped nodes are recycled through the pool, so several rounds exercise reuse too
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            int *val = malloc(sizeof(int));
+            *val = i;
+            atm_stack_push(&s, val);
+        }
+
+        for (int i = 999; i >= 0; i--)
+        {
+            int *val = atm_stack_pop(&s);
+            if (val == NULL || *val != i)
+            {
+                fprintf(stderr, "unexpected value when popping: %d != %d\n", val ? *val : -1, i);
+                return 1;
+            }
+            free(val);
+        }
+
+        if (atm_stack_pop(&s) != NULL)
+        {
+            fprintf(stderr, "pop succeeded on an empty stack\n");
+            return 1;
+        }
+    }
+
+    // leave some items behind for free to clean up
+    for (int i = 0; i < 10; i++)
+        atm_stack_push(&s, malloc(sizeof(int)));
+
+    struct atm_stats stats;
+    atm_stack_stats(&s, &stats);
+#ifdef ATM_STATS
+    if (stats.retired != 3000 || stats.empty_dequeues != 4)
+    {
+        fprintf(stderr, "expected 3000 retired nodes and 4 empty pops, got %lu and %lu\n", stats.retired, stats.empty_dequeues);
+        return 1;
+    }
+#else
+    if (stats.retired != 0)
+    {
+        fprintf(stderr, "stats counted without ATM_STATS\n");
+        return 1;
+    }
+#endif
+
+    free_atm_stack_auto(&s);
+    return 0;
+}
+
+void *stack_offer_body(void *arg)
+{
+    atm_stack *s = arg;
+    int *val = malloc(sizeof(int));
+    *val = 42;
+    atm_stack_push(s, val);
+    return NULL;
+}
+
+int test_stack_elimination_handoff()
+{
+    atm_stack s;
+    atm_stack_init(&s);
+    s.eliminate_first = true;
+
+    // nobody takes an offer that is withdrawn straight away, so the item still lands on top
+    s.elimination_spins = 0;
+    int *val = malloc(sizeof(int));
+    *val = 7;
+    atm_stack_push(&s, val);
+    if (atomic_load(&s.top) == NULL)
+    {
+        fprintf(stderr, "withdrawn offer never reached the stack\n");
+        return 1;
+    }
+    for (int i = 0; i < ATM_STACK_ELIMINATION_SLOTS; i++)
+    {
+        if (atomic_load(&s.elimination[i].item) != NULL)
+        {
+            fprintf(stderr, "withdrawn offer left behind in slot %d\n", i);
+            return 1;
+        }
+    }
+    if ((val = atm_stack_pop(&s)) == NULL || *val != 7)
+    {
+        fprintf(stderr, "unexpected value when popping: %d != 7\n", val ? *val : -1);
+        return 1;
+    }
+    free(val);
+
+    // this push waits in its slot until taken, top stays empty so the pop can only get the item through the slot
+    s.elimination_spins = UINT_MAX;
+    pthread_t pusher;
+    int status;
+    if ((status = pthread_create(&pusher, NULL, stack_offer_body, &s)))
+    {
+        fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+        return 1;
+    }
+
+    bool offered = false;
+    while (!offered)
+    {
+        sched_yield();
+        for (int i = 0; i < ATM_STACK_ELIMINATION_SLOTS; i++)
+            offered |= atomic_load(&s.elimination[i].item) != NULL;
+    }
+    while ((val = atm_stack_pop(&s)) == NULL)
+        ;
+
+    if ((status = pthread_join(pusher, NULL)))
+    {
+        fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+        return 1;
+    }
+    if (*val != 42 || atomic_load(&s.top) != NULL)
+    {
+        fprintf(stderr, "expected the offered item and an empty stack, popped %d\n", *val);
+        return 1;
+    }
+    free(val);
+
+    // the eliminated push's node may still be protected by a pop on the pool, so it has to be retired
+    if (atomic_load(&s.free_nodes) != NULL || atomic_load(&s.retired) == NULL)
+    {
+        fprintf(stderr, "eliminated push pooled its node instead of retiring it\n");
+        return 1;
+    }
+
+    struct atm_stats stats;
+    atm_stack_stats(&s, &stats);
+#ifdef ATM_STATS
+    // the push and the pop each count the exchange
+    if (stats.eliminations != 2)
+    {
+        fprintf(stderr, "expected 2 eliminations, got %lu\n", stats.eliminations);
+        return 1;
+    }
+#endif
+
+    free_atm_stack_auto(&s);
+    return 0;
+}
+
+struct elimination_args {
+    atm_stack *s;
+    int first;
+    int niter;
+    int total;
+    _Atomic int *consumed;
+    _Atomic bool *seen;
+    int failed;
+};
+
+void *elimination_producer_body(void *arg)
+{
+    struct elimination_args *args = (struct elimination_args *)arg;
+    for (int i = 0; i < args->niter; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = args->first + i;
+        atm_stack_push(args->s, val);
+    }
+    return NULL;
+}
+
+void *elimination_consumer_body(void *arg)
+{
+    struct elimination_args *args = (struct elimination_args *)arg;
+    while (atomic_load_explicit(args->consumed, memory_order_relaxed) < args->total)
+    {
+        int *val = atm_stack_pop(args->s);
+        if (!val)
+            continue;
+        if (atomic_exchange_explicit(&(args->seen[*val]), true, memory_order_relaxed))
+        {
+            fprintf(stderr, "item %d popped twice\n", *val);
+            args->failed = 1;
+        }
+        atomic_fetch_add_explicit(args->consumed, 1, memory_order_relaxed);
+        free(val);
+    }
+    return NULL;
+}
+
+int test_stack_elimination_contended(int niter)
+{
+    atm_stack *s = malloc(sizeof(atm_stack));
+    atm_stack_init(s);
+    s->eliminate_first = true;
+    // long enough that a pop usually runs while a push is waiting, short enough that most offers are withdrawn too
+    s->elimination_spins = 4096;
+
+    pthread_t threads[4];
+    struct elimination_args args[4];
+    _Atomic int consumed = 0;
+    _Atomic bool *seen = calloc(2 * niter, sizeof(_Atomic bool));
+
+    for (int i = 0; i < 4; i++)
+    {
+        args[i] = (struct elimination_args) { .s=s, .first=(i % 2) * niter, .niter=niter, .total=2 * niter, .consumed=&consumed, .seen=seen };
+        int status;
+        if ((status = pthread_create(threads + i, NULL, i < 2 ? elimination_producer_body : elimination_consumer_body, args + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+        if (args[i].failed)
+            return 1;
+    }
+
+    for (int i = 0; i < 2 * niter; i++)
+    {
+        if (!atomic_load(&seen[i]))
+        {
+            fprintf(stderr, "item %d was never popped\n", i);
+            return 1;
+        }
+    }
+    if (atm_stack_pop(s) != NULL)
+    {
+        fprintf(stderr, "pop succeeded after every item was consumed\n");
+        return 1;
+    }
+
+    struct atm_stats stats;
+    atm_stack_stats(s, &stats);
+#ifdef ATM_STATS
+    if (stats.eliminations == 0)
+    {
+        fprintf(stderr, "no push and pop ever met in the elimination array\n");
+        return 1;
+    }
+    printf("stack eliminations with eliminate_first: %lu\n", stats.eliminations);
+#endif
+
+    free(seen);
+    free_atm_stack(s);
+    return 0;
+}
+
+void *stack_producer_body(void *arg)
+{
+    struct stack_args *args = (struct stack_args *)arg;
+    for (int i = 0; i < args->niter; i++)
+    {
+        int *val = malloc(sizeof(int));
+        *val = i;
+        atm_stack_push(args->s, val);
+    }
+    return NULL;
+}
+
+void *stack_consumer_body(void *arg)
+{
+    struct stack_args *args = (struct stack_args *)arg;
+    while (atomic_load_explicit(args->total_consumed, memory_order_relaxed) < 4 * args->niter)
+    {
+        int *val = atm_stack_pop(args->s);
+        if (!val)
+        {
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_add_explicit(args->sum, *val, memory_order_relaxed);
+        atomic_fetch_add_explicit(args->total_consumed, 1, memory_order_relaxed);
+        free(val);
+    }
+    return NULL;
+}
+
+int test_stack_multi_producer_multi_consumer(int niter)
+{
+    atm_stack *s = malloc(sizeof(atm_stack));
+    atm_stack_init(s);
+
+    pthread_t threads[8];
+    _Atomic int total_consumed = 0;
+    _Atomic long long sum = 0;
+    struct stack_args args = { .s=s, .niter=niter, .total_consumed=&total_consumed, .sum=&sum };
+
+    for (int i = 0; i < 8; i++)
+    {
+        int status;
+        if ((status = pthread_create(threads + i, NULL, i < 4 ? stack_producer_body : stack_consumer_body, &args)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        int status;
+        if ((status = pthread_join(threads[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    long long expected = 4 * ((long long)niter * (niter - 1) / 2);
+    if (atomic_load(&sum) != expected)
+    {
+        fprintf(stderr, "sum of popped items %lld != %lld\n", atomic_load(&sum), expected);
+        return 1;
+    }
+
+    struct atm_stats stats;
+    atm_stack_stats(s, &stats);
+    printf("stack cas retries: %lu eliminations: %lu\n", stats.cas_retries, stats.eliminations);
+
+    if (atm_stack_pop(s) != NULL)
+    {
+        fprintf(stderr, "pop succeeded after every item was consumed\n");
+        return 1;
+    }
+
+    free_atm_stack(s);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_stack_single_threaded())
+        return 1;
+
+    if (test_stack_multi_producer_multi_consumer(200000))
+        return 1;
+
+    if (test_stack_elimination_handoff())
+        return 1;
+
+    if (test_stack_elimination_contended(20000))
+        return 1;
+
+    return 0;
+}
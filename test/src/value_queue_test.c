@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "value_queue.h"
+
+struct message {
+    int producer;
+    int seq;
+    double payload;
+};
+
+ATM_QUEUE_DEFINE(int_queue, int)
+ATM_QUEUE_DEFINE(message_queue, struct message)
+
+struct producer_args {
+    message_queue *q;
+    int niter;
+    int id;
+};
+
+struct consumer_args {
+    message_queue *q;
+    int nproducers;
+    _Atomic int *total_consumed;
+    int total;
+    int failed;
+};
+
+int test_value_queue_single_threaded()
+{
+    int_queue q;
+    int_queue_init(&q);
+
+    int out;
+    if (int_queue_try_dequeue(&q, &out))
+    {
+        fprintf(stderr, "dequeue succeeded on an empty queue\n");
+        return 1;
+    }
+
+    // interleave enqueues and dequeues so nodes cycle through the pool
+    int next = 0;
+    int expected = 0;
+    for (int round = 0; round < 100; round++)
+    {
+        for (int i = 0; i < 100; i++)
+            int_queue_enqueue(&q, next++);
+
+        for (int i = 0; i < 50; i++)
+        {
+            if (!int_queue_try_dequeue(&q, &out) || out != expected)
+            {
+                fprintf(stderr, "unexpected value when dequeuing: %d != %d\n", out, expected);
+                return 1;
+            }
+            expected++;
+        }
+    }
+
+    while (int_queue_try_dequeue(&q, &out))
+    {
+        if (out != expected)
+        {
+            fprintf(stderr, "unexpected value when draining: %d != %d\n", out, expected);
+            return 1;
+        }
+        expected++;
+    }
+
+    if (expected != next)
+    {
+        fprintf(stderr, "drained %d of %d values\n", expected, next);
+        return 1;
+    }
+
+    free_int_queue_auto(&q);
+
+    return 0;
+}
+
+void *producer_body(void *args)
+{
+    struct producer_args *pargs = (struct producer_args *)args;
+    for (int i = 0; i < pargs->niter; i++)
+    {
+        struct message msg = { .producer=pargs->id, .seq=i, .payload=i * 0.5 };
+        message_queue_enqueue(pargs->q, msg);
+    }
+
+    return NULL;
+}
+
+void *consumer_body(void *args)
+{
+    struct consumer_args *cargs = (struct consumer_args *)args;
+    int last_seq[cargs->nproducers];
+    for (int i = 0; i < cargs->nproducers; i++)
+        last_seq[i] = -1;
+
+    while (atomic_load_explicit(cargs->total_consumed, memory_order_relaxed) < cargs->total)
+    {
+        struct message msg;
+        if (!message_queue_try_dequeue(cargs->q, &msg))
+        {
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_add_explicit(cargs->total_consumed, 1, memory_order_relaxed);
+
+        // a single consumer sees each producer's messages in order, and a message is never torn
+        if (msg.seq <= last_seq[msg.producer] || msg.payload != msg.seq * 0.5)
+        {
+            fprintf(stderr, "message from producer %d out of order or torn: seq %d after %d\n",
+                    msg.producer, msg.seq, last_seq[msg.producer]);
+            cargs->failed = 1;
+        }
+        last_seq[msg.producer] = msg.seq;
+    }
+
+    return NULL;
+}
+
+int test_value_queue_multi_producer_multi_consumer(int niter)
+{
+    message_queue *q = malloc(sizeof(message_queue));
+    message_queue_init(q);
+
+    pthread_t producers[4];
+    pthread_t consumers[4];
+    struct producer_args pargs[4];
+    struct consumer_args cargs[4];
+    _Atomic int total_consumed = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        cargs[i] = (struct consumer_args) { .q=q, .nproducers=4, .total_consumed=&total_consumed, .total=4 * niter, .failed=0 };
+        int status;
+        if ((status = pthread_create(consumers + i, NULL, consumer_body, cargs + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        pargs[i] = (struct producer_args) { .q=q, .niter=niter, .id=i };
+        int status;
+        if ((status = pthread_create(producers + i, NULL, producer_body, pargs + i)))
+        {
+            fprintf(stderr, "unable to create thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(producers[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int status;
+        if ((status = pthread_join(consumers[i], NULL)))
+        {
+            fprintf(stderr, "unable to join thread: (%d) %s\n", status, strerror(status));
+            return 1;
+        }
+        if (cargs[i].failed)
+            return 1;
+    }
+
+    struct message msg;
+    if (atomic_load(&total_consumed) != 4 * niter || message_queue_try_dequeue(q, &msg))
+    {
+        fprintf(stderr, "consumed %d of %d messages\n", atomic_load(&total_consumed), 4 * niter);
+        return 1;
+    }
+
+    free_message_queue(q);
+
+    return 0;
+}
+
+int main(void)
+{
+    if (test_value_queue_single_threaded())
+        return 1;
+
+    if (test_value_queue_multi_producer_multi_consumer(100000))
+        return 1;
+
+    return 0;
+}